@@ -0,0 +1,95 @@
+#include "async_search_server.h"
+
+#include <algorithm>
+
+using namespace std;
+
+AsyncSearchServer::AsyncSearchServer(const SearchServer& search_server, AsyncSearchOptions options)
+    : search_server_(search_server)
+    , options_(options) {
+    if (options_.max_queued_queries == 0) {
+        throw invalid_argument("Queue limit must be positive"s);
+    }
+    const size_t worker_count = options_.worker_threads != 0 ? options_.worker_threads
+                                                             : max(thread::hardware_concurrency(), 1u);
+    for (size_t i = 0; i < worker_count; ++i) {
+        workers_.emplace_back([this] { WorkerLoop(); });
+    }
+}
+
+AsyncSearchServer::~AsyncSearchServer() {
+    {
+        lock_guard guard(mutex_);
+        stopping_ = true;
+    }
+    has_tasks_.notify_all();
+    for (thread& worker : workers_) {
+        worker.join();
+    }
+}
+
+QueryAwaitable<vector<Document>> AsyncSearchServer::FindTopDocumentsAsync(string_view raw_query, DocumentStatus status) {
+    return SubmitAwaitable<vector<Document>>([this, query = string(raw_query), status] {
+        return search_server_.FindTopDocuments(query, status);
+    });
+}
+
+QueryAwaitable<tuple<vector<string_view>, DocumentStatus>> AsyncSearchServer::MatchDocumentAsync(string_view raw_query,
+    int document_id) {
+    return SubmitAwaitable<tuple<vector<string_view>, DocumentStatus>>([this, query = string(raw_query), document_id] {
+        return search_server_.MatchDocument(query, document_id);
+    });
+}
+
+future<vector<Document>> AsyncSearchServer::FindTopDocumentsFuture(string_view raw_query, DocumentStatus status) {
+    return SubmitFuture<vector<Document>>([this, query = string(raw_query), status] {
+        return search_server_.FindTopDocuments(query, status);
+    });
+}
+
+future<tuple<vector<string_view>, DocumentStatus>> AsyncSearchServer::MatchDocumentFuture(string_view raw_query,
+    int document_id) {
+    return SubmitFuture<tuple<vector<string_view>, DocumentStatus>>([this, query = string(raw_query), document_id] {
+        return search_server_.MatchDocument(query, document_id);
+    });
+}
+
+AsyncSearchStats AsyncSearchServer::GetStats() const {
+    lock_guard guard(mutex_);
+    AsyncSearchStats stats;
+    stats.completed = completed_;
+    stats.rejected = rejected_;
+    stats.queued = tasks_.size();
+    return stats;
+}
+
+void AsyncSearchServer::Push(function<void()> task) {
+    {
+        lock_guard guard(mutex_);
+        if (tasks_.size() >= options_.max_queued_queries) {
+            ++rejected_;
+            throw OverloadError("Search queue is full: "s + to_string(tasks_.size()) + " queries waiting"s);
+        }
+        tasks_.push_back(move(task));
+    }
+    has_tasks_.notify_one();
+}
+
+void AsyncSearchServer::WorkerLoop() {
+    for (;;) {
+        function<void()> task;
+        {
+            unique_lock lock(mutex_);
+            has_tasks_.wait(lock, [this] { return stopping_ || !tasks_.empty(); });
+            if (tasks_.empty()) {
+                return;
+            }
+            task = move(tasks_.front());
+            tasks_.pop_front();
+        }
+        // a resumed coroutine runs inside the task, so it is counted when it suspends again or ends
+        task();
+        lock_guard guard(mutex_);
+        ++completed_;
+    }
+}
@@ -0,0 +1,180 @@
+#pragma once
+
+#include "document.h"
+#include "search_server.h"
+
+#include <condition_variable>
+#include <coroutine>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+// Thrown by the asynchronous calls when the executor's queue is full
+class OverloadError : public std::runtime_error {
+public:
+    using std::runtime_error::runtime_error;
+};
+
+struct AsyncSearchOptions {
+    // 0 means one per hardware thread
+    size_t worker_threads = 0;
+    // Queries submitted but not yet picked up by a worker, further calls throw OverloadError
+    size_t max_queued_queries = 1024;
+};
+
+struct AsyncSearchStats {
+    size_t completed = 0;
+    size_t rejected = 0;
+    // Waiting in the queue right now
+    size_t queued = 0;
+};
+
+// Result of an asynchronous query for co_await. The query is already running when the awaitable
+// is returned; a coroutine that has to wait is resumed on the executor thread that finished the query.
+// Awaiting rethrows the query's exception. Awaited at most once
+template <typename T>
+class QueryAwaitable {
+public:
+    struct State {
+        std::mutex mutex;
+        std::optional<T> value;
+        std::exception_ptr error;
+        bool ready = false;
+        std::coroutine_handle<> waiter;
+
+        // Called once by the worker with the outcome of the query
+        void Finish(std::optional<T> result, std::exception_ptr exception) {
+            std::coroutine_handle<> to_resume;
+            {
+                std::lock_guard guard(mutex);
+                value = std::move(result);
+                error = exception;
+                ready = true;
+                to_resume = std::exchange(waiter, nullptr);
+            }
+            if (to_resume) {
+                to_resume.resume();
+            }
+        }
+    };
+
+    explicit QueryAwaitable(std::shared_ptr<State> state)
+        : state_(std::move(state)) { }
+
+    bool await_ready() const {
+        std::lock_guard guard(state_->mutex);
+        return state_->ready;
+    }
+
+    // Doesn't suspend if the query finished since await_ready
+    bool await_suspend(std::coroutine_handle<> handle) {
+        std::lock_guard guard(state_->mutex);
+        if (state_->ready) {
+            return false;
+        }
+        state_->waiter = handle;
+        return true;
+    }
+
+    T await_resume() {
+        std::lock_guard guard(state_->mutex);
+        if (state_->error) {
+            std::rethrow_exception(state_->error);
+        }
+        return std::move(*state_->value);
+    }
+
+private:
+    std::shared_ptr<State> state_;
+};
+
+// Runs queries against a SearchServer on an internal pool of workers, so the calling thread
+// never blocks on a query. Every call submits right away and throws OverloadError instead of
+// queueing more than max_queued_queries. Query texts are copied, the caller's may go away.
+// The server must not be modified while queries run; the destructor finishes the queued ones
+class AsyncSearchServer {
+public:
+    explicit AsyncSearchServer(const SearchServer& search_server, AsyncSearchOptions options = {});
+
+    AsyncSearchServer(const AsyncSearchServer&) = delete;
+    AsyncSearchServer& operator=(const AsyncSearchServer&) = delete;
+
+    ~AsyncSearchServer();
+
+    QueryAwaitable<std::vector<Document>> FindTopDocumentsAsync(std::string_view raw_query,
+        DocumentStatus status = DocumentStatus::ACTUAL);
+
+    QueryAwaitable<std::tuple<std::vector<std::string_view>, DocumentStatus>> MatchDocumentAsync(
+        std::string_view raw_query, int document_id);
+
+    std::future<std::vector<Document>> FindTopDocumentsFuture(std::string_view raw_query,
+        DocumentStatus status = DocumentStatus::ACTUAL);
+
+    // The matched words point into the server, not into the query
+    std::future<std::tuple<std::vector<std::string_view>, DocumentStatus>> MatchDocumentFuture(
+        std::string_view raw_query, int document_id);
+
+    AsyncSearchStats GetStats() const;
+
+private:
+    template <typename T, typename Function>
+    QueryAwaitable<T> SubmitAwaitable(Function function);
+
+    template <typename T, typename Function>
+    std::future<T> SubmitFuture(Function function);
+
+    // Throws OverloadError if the queue is full
+    void Push(std::function<void()> task);
+
+    void WorkerLoop();
+
+    const SearchServer& search_server_;
+    AsyncSearchOptions options_;
+
+    mutable std::mutex mutex_;
+    std::condition_variable has_tasks_;
+    std::deque<std::function<void()>> tasks_;
+    bool stopping_ = false;
+    size_t completed_ = 0;
+    size_t rejected_ = 0;
+
+    std::vector<std::thread> workers_;
+};
+
+template <typename T, typename Function>
+QueryAwaitable<T> AsyncSearchServer::SubmitAwaitable(Function function) {
+    using State = typename QueryAwaitable<T>::State;
+    auto state = std::make_shared<State>();
+    Push([state, function = std::move(function)] {
+        std::optional<T> result;
+        std::exception_ptr error;
+        try {
+            result.emplace(function());
+        } catch (...) {
+            error = std::current_exception();
+        }
+        state->Finish(std::move(result), error);
+    });
+    return QueryAwaitable<T>(std::move(state));
+}
+
+template <typename T, typename Function>
+std::future<T> AsyncSearchServer::SubmitFuture(Function function) {
+    // std::function needs a copyable target, the task itself is move-only
+    auto task = std::make_shared<std::packaged_task<T()>>(std::move(function));
+    auto result = task->get_future();
+    Push([task] { (*task)(); });
+    return result;
+}
@@ -0,0 +1,269 @@
+#include "block_io.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <deque>
+#include <execution>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#if __has_include(<linux/io_uring.h>) && defined(__NR_io_uring_setup)
+#include <linux/io_uring.h>
+#define SEARCH_SERVER_HAS_IO_URING 1
+#endif
+
+using namespace std;
+
+namespace {
+
+// Large blocks are split so that a single request doesn't hit the kernel's per-call limit
+const size_t MAX_IO_SIZE = 1 << 26;
+
+vector<WriteRequest> SplitRequests(span<const WriteRequest> requests) {
+    vector<WriteRequest> pieces;
+    for (const WriteRequest& request : requests) {
+        for (size_t done = 0; done < request.size; done += MAX_IO_SIZE) {
+            pieces.push_back({request.data + done, min(MAX_IO_SIZE, request.size - done), request.offset + done});
+        }
+    }
+    return pieces;
+}
+
+void WriteBlocksWithPwrite(int fd, const vector<WriteRequest>& pieces) {
+    atomic<int> error = 0;
+    for_each(execution::par, pieces.begin(), pieces.end(), [fd, &error](const WriteRequest& piece) {
+        size_t written = 0;
+        while (written < piece.size) {
+            const ssize_t result = pwrite(fd, piece.data + written, piece.size - written, piece.offset + written);
+            if (result < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                error = errno;
+                return;
+            }
+            written += static_cast<size_t>(result);
+        }
+    });
+    if (error != 0) {
+        throw runtime_error("Block write failed: "s + strerror(error));
+    }
+}
+
+#ifdef SEARCH_SERVER_HAS_IO_URING
+
+// Minimal io_uring submission ring over raw system calls, the project doesn't depend on liburing
+class IoUring {
+public:
+    static constexpr unsigned QUEUE_DEPTH = 64;
+
+    // Leaves the ring invalid if the kernel refuses to create it
+    IoUring() {
+        io_uring_params params;
+        memset(&params, 0, sizeof(params));
+        ring_fd_ = static_cast<int>(syscall(__NR_io_uring_setup, QUEUE_DEPTH, &params));
+        if (ring_fd_ < 0) {
+            return;
+        }
+
+        sq_size_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        cq_size_ = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        single_mmap_ = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+        if (single_mmap_) {
+            sq_size_ = cq_size_ = max(sq_size_, cq_size_);
+        }
+
+        sq_ring_ = mmap(nullptr, sq_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_SQ_RING);
+        cq_ring_ = single_mmap_ ? sq_ring_
+            : mmap(nullptr, cq_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_CQ_RING);
+        sqes_size_ = params.sq_entries * sizeof(io_uring_sqe);
+        void* sqes = mmap(nullptr, sqes_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_SQES);
+        if (sq_ring_ == MAP_FAILED || cq_ring_ == MAP_FAILED || sqes == MAP_FAILED) {
+            Release();
+            return;
+        }
+
+        char* sq = static_cast<char*>(sq_ring_);
+        char* cq = static_cast<char*>(cq_ring_);
+        sq_tail_ = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+        sq_mask_ = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+        sq_array_ = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+        sq_entries_ = params.sq_entries;
+        cq_head_ = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+        cq_tail_ = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+        cq_mask_ = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+        cqes_ = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+        sqes_ = static_cast<io_uring_sqe*>(sqes);
+    }
+
+    IoUring(const IoUring&) = delete;
+    IoUring& operator=(const IoUring&) = delete;
+
+    ~IoUring() {
+        Release();
+    }
+
+    bool IsValid() const {
+        return sqes_ != nullptr;
+    }
+
+    // Returns 0 or the errno of the first failed write
+    int Write(int fd, const vector<WriteRequest>& pieces) {
+        deque<WriteRequest> queued(pieces.begin(), pieces.end());
+        vector<WriteRequest> in_flight(sq_entries_);
+        vector<unsigned> free_slots(sq_entries_);
+        for (unsigned slot = 0; slot < sq_entries_; ++slot) {
+            free_slots[slot] = slot;
+        }
+
+        // after a failure the blocks in flight are still drained, they reference the caller's buffers
+        int error = 0;
+        size_t pending = 0;
+        // entries in the submission ring the kernel hasn't taken yet
+        unsigned unsubmitted = 0;
+        while ((error == 0 && !queued.empty()) || pending > 0) {
+            unsigned submitted = 0;
+            unsigned tail = *sq_tail_;
+            while (error == 0 && !queued.empty() && !free_slots.empty()) {
+                const unsigned slot = free_slots.back();
+                free_slots.pop_back();
+                in_flight[slot] = queued.front();
+                queued.pop_front();
+
+                io_uring_sqe& sqe = sqes_[slot];
+                memset(&sqe, 0, sizeof(sqe));
+                sqe.opcode = IORING_OP_WRITE;
+                sqe.fd = fd;
+                sqe.addr = reinterpret_cast<uint64_t>(in_flight[slot].data);
+                sqe.len = static_cast<uint32_t>(in_flight[slot].size);
+                sqe.off = in_flight[slot].offset;
+                sqe.user_data = slot;
+                sq_array_[tail & sq_mask_] = slot;
+                ++tail;
+                ++submitted;
+            }
+            __atomic_store_n(sq_tail_, tail, __ATOMIC_RELEASE);
+            pending += submitted;
+            unsubmitted += submitted;
+
+            // an interrupted or busy call is repeated, the completions that did arrive are reaped first
+            const long entered = syscall(__NR_io_uring_enter, ring_fd_, unsubmitted, 1, IORING_ENTER_GETEVENTS, nullptr, 0);
+            if (entered >= 0) {
+                unsubmitted -= static_cast<unsigned>(entered);
+            }
+            else if (errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+                // the entries the kernel hasn't taken are withdrawn, the taken ones are drained like after a failed write.
+                // Completions are posted without io_uring_enter, so a ring that keeps failing is polled
+                error = error != 0 ? error : errno;
+                __atomic_store_n(sq_tail_, *sq_tail_ - unsubmitted, __ATOMIC_RELEASE);
+                pending -= unsubmitted;
+                unsubmitted = 0;
+                sched_yield();
+            }
+
+            unsigned head = *cq_head_;
+            while (head != __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE)) {
+                const io_uring_cqe& cqe = cqes_[head & cq_mask_];
+                const unsigned slot = static_cast<unsigned>(cqe.user_data);
+                const int result = cqe.res;
+                ++head;
+                --pending;
+                free_slots.push_back(slot);
+
+                // like pwrite, an interrupted write is retried and a short one is resubmitted for the rest
+                const WriteRequest& piece = in_flight[slot];
+                if (result == -EINTR || result == -EAGAIN) {
+                    queued.push_back(piece);
+                    continue;
+                }
+                if (result <= 0) {
+                    error = error != 0 ? error : (result < 0 ? -result : EIO);
+                    continue;
+                }
+                if (static_cast<size_t>(result) < piece.size) {
+                    queued.push_back({piece.data + result, piece.size - result, piece.offset + result});
+                }
+            }
+            __atomic_store_n(cq_head_, head, __ATOMIC_RELEASE);
+        }
+        return error;
+    }
+
+private:
+    void Release() {
+        if (sqes_ != nullptr) {
+            munmap(sqes_, sqes_size_);
+            sqes_ = nullptr;
+        }
+        if (cq_ring_ != nullptr && cq_ring_ != MAP_FAILED && !single_mmap_) {
+            munmap(cq_ring_, cq_size_);
+        }
+        if (sq_ring_ != nullptr && sq_ring_ != MAP_FAILED) {
+            munmap(sq_ring_, sq_size_);
+        }
+        cq_ring_ = sq_ring_ = nullptr;
+        if (ring_fd_ >= 0) {
+            close(ring_fd_);
+            ring_fd_ = -1;
+        }
+    }
+
+    int ring_fd_ = -1;
+    bool single_mmap_ = false;
+    size_t sq_size_ = 0;
+    size_t cq_size_ = 0;
+    size_t sqes_size_ = 0;
+    void* sq_ring_ = nullptr;
+    void* cq_ring_ = nullptr;
+
+    unsigned* sq_tail_ = nullptr;
+    unsigned sq_mask_ = 0;
+    unsigned* sq_array_ = nullptr;
+    unsigned sq_entries_ = 0;
+    unsigned* cq_head_ = nullptr;
+    unsigned* cq_tail_ = nullptr;
+    unsigned cq_mask_ = 0;
+    io_uring_cqe* cqes_ = nullptr;
+    io_uring_sqe* sqes_ = nullptr;
+};
+
+#endif
+
+}  // namespace
+
+bool IsIoUringAvailable() {
+#ifdef SEARCH_SERVER_HAS_IO_URING
+    static const bool available = IoUring().IsValid();
+    return available;
+#else
+    return false;
+#endif
+}
+
+void WriteBlocks(int fd, span<const WriteRequest> requests) {
+    const vector<WriteRequest> pieces = SplitRequests(requests);
+
+#ifdef SEARCH_SERVER_HAS_IO_URING
+    IoUring ring;
+    if (ring.IsValid()) {
+        const int error = ring.Write(fd, pieces);
+        // kernels without IORING_OP_WRITE reject the opcode, plain writes still work there
+        if (error == 0) {
+            return;
+        }
+        if (error != EINVAL && error != EOPNOTSUPP) {
+            throw runtime_error("Block write failed: "s + strerror(error));
+        }
+    }
+#endif
+
+    WriteBlocksWithPwrite(fd, pieces);
+}
@@ -0,0 +1,18 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+
+struct WriteRequest {
+    const char* data = nullptr;
+    size_t size = 0;
+    uint64_t offset = 0;
+};
+
+// Writes all the blocks at their offsets. Blocks are submitted through io_uring
+// where the kernel supports it, otherwise pwrite calls are spread over worker threads.
+// Throws std::runtime_error if any write fails
+void WriteBlocks(int fd, std::span<const WriteRequest> requests);
+
+bool IsIoUringAvailable();
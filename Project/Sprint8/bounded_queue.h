@@ -0,0 +1,116 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <stdexcept>
+#include <utility>
+
+// Bounded multi-producer multi-consumer lock-free queue (Dmitry Vyukov's ring of sequenced cells).
+// Capacity is rounded up to a power of two, at least two cells are needed to tell
+// a full ring from an empty one. TryPush and TryPop never block,
+// callers decide how to wait when the queue is full or empty
+template <typename T>
+class BoundedQueue {
+public:
+    explicit BoundedQueue(size_t capacity);
+
+    BoundedQueue(const BoundedQueue&) = delete;
+    BoundedQueue& operator=(const BoundedQueue&) = delete;
+
+    // Leaves value untouched and returns false if the queue is full
+    bool TryPush(T& value);
+
+    // Returns false if the queue is empty
+    bool TryPop(T& value);
+
+    size_t GetCapacity() const {
+        return mask_ + 1;
+    }
+
+    // Approximate while other threads use the queue
+    size_t GetSize() const;
+
+private:
+    struct Cell {
+        std::atomic<size_t> sequence;
+        T value;
+    };
+
+    // Producers and consumers touch different cache lines
+    static constexpr size_t CACHE_LINE_SIZE = 64;
+
+    std::unique_ptr<Cell[]> cells_;
+    size_t mask_ = 0;
+    alignas(CACHE_LINE_SIZE) std::atomic<size_t> enqueue_position_ = 0;
+    alignas(CACHE_LINE_SIZE) std::atomic<size_t> dequeue_position_ = 0;
+};
+
+template <typename T>
+BoundedQueue<T>::BoundedQueue(size_t capacity) {
+    if (capacity == 0) {
+        throw std::invalid_argument("Queue capacity must be positive");
+    }
+    size_t rounded = 2;
+    while (rounded < capacity) {
+        rounded *= 2;
+    }
+    mask_ = rounded - 1;
+    cells_ = std::make_unique<Cell[]>(rounded);
+    for (size_t i = 0; i < rounded; ++i) {
+        cells_[i].sequence.store(i, std::memory_order_relaxed);
+    }
+}
+
+template <typename T>
+bool BoundedQueue<T>::TryPush(T& value) {
+    size_t position = enqueue_position_.load(std::memory_order_relaxed);
+    for (;;) {
+        Cell& cell = cells_[position & mask_];
+        const size_t sequence = cell.sequence.load(std::memory_order_acquire);
+        const auto difference = static_cast<std::ptrdiff_t>(sequence) - static_cast<std::ptrdiff_t>(position);
+        if (difference == 0) {
+            if (enqueue_position_.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                cell.value = std::move(value);
+                cell.sequence.store(position + 1, std::memory_order_release);
+                return true;
+            }
+        }
+        else if (difference < 0) {
+            return false;
+        }
+        else {
+            position = enqueue_position_.load(std::memory_order_relaxed);
+        }
+    }
+}
+
+template <typename T>
+bool BoundedQueue<T>::TryPop(T& value) {
+    size_t position = dequeue_position_.load(std::memory_order_relaxed);
+    for (;;) {
+        Cell& cell = cells_[position & mask_];
+        const size_t sequence = cell.sequence.load(std::memory_order_acquire);
+        const auto difference = static_cast<std::ptrdiff_t>(sequence) - static_cast<std::ptrdiff_t>(position + 1);
+        if (difference == 0) {
+            if (dequeue_position_.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                value = std::move(cell.value);
+                cell.sequence.store(position + mask_ + 1, std::memory_order_release);
+                return true;
+            }
+        }
+        else if (difference < 0) {
+            return false;
+        }
+        else {
+            position = dequeue_position_.load(std::memory_order_relaxed);
+        }
+    }
+}
+
+template <typename T>
+size_t BoundedQueue<T>::GetSize() const {
+    const size_t enqueued = enqueue_position_.load(std::memory_order_relaxed);
+    const size_t dequeued = dequeue_position_.load(std::memory_order_relaxed);
+    return enqueued > dequeued ? enqueued - dequeued : 0;
+}
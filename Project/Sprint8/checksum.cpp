@@ -0,0 +1,21 @@
+#include "checksum.h"
+
+#include <cstring>
+
+using namespace std;
+
+// FNV-1a over 64-bit words with an extra shift to spread the high bits
+uint64_t ComputeChecksum(const char* data, size_t size) {
+    uint64_t hash = 0xcbf29ce484222325ull;
+    size_t i = 0;
+    for (; i + sizeof(uint64_t) <= size; i += sizeof(uint64_t)) {
+        uint64_t word;
+        memcpy(&word, data + i, sizeof(word));
+        hash = (hash ^ word) * 0x100000001b3ull;
+        hash ^= hash >> 29;
+    }
+    for (; i < size; ++i) {
+        hash = (hash ^ static_cast<unsigned char>(data[i])) * 0x100000001b3ull;
+    }
+    return hash;
+}
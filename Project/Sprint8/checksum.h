@@ -0,0 +1,7 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Fast 64-bit checksum for detecting damaged or torn data on disk
+uint64_t ComputeChecksum(const char* data, size_t size);
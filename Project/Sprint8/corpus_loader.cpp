@@ -0,0 +1,217 @@
+#include "corpus_loader.h"
+#include "mapped_file.h"
+
+#include <algorithm>
+#include <charconv>
+#include <deque>
+#include <future>
+#include <optional>
+#include <stdexcept>
+#include <thread>
+
+using namespace std;
+
+namespace {
+
+struct ParsedChunk {
+    CorpusBatch batch;
+    size_t bytes = 0;
+    chrono::nanoseconds parse_time{0};
+};
+
+[[noreturn]] void ThrowMalformedLine(size_t offset, const string& reason) {
+    throw invalid_argument("Malformed corpus line at byte "s + to_string(offset) + ": "s + reason);
+}
+
+// Cuts the field up to the next tab off the line
+string_view TakeField(string_view& line) {
+    const size_t tab = line.find('\t');
+    if (tab == string_view::npos) {
+        return {};
+    }
+    const string_view field = line.substr(0, tab);
+    line.remove_prefix(tab + 1);
+    return field;
+}
+
+optional<int> ParseInt(string_view text) {
+    int value = 0;
+    const auto [end, error] = from_chars(text.data(), text.data() + text.size(), value);
+    if (error != errc() || end != text.data() + text.size() || text.empty()) {
+        return nullopt;
+    }
+    return value;
+}
+
+optional<DocumentStatus> ParseStatus(string_view text) {
+    if (text == "ACTUAL"sv) {
+        return DocumentStatus::ACTUAL;
+    }
+    if (text == "IRRELEVANT"sv) {
+        return DocumentStatus::IRRELEVANT;
+    }
+    if (text == "BANNED"sv) {
+        return DocumentStatus::BANNED;
+    }
+    if (text == "REMOVED"sv) {
+        return DocumentStatus::REMOVED;
+    }
+    return nullopt;
+}
+
+void ParseLine(string_view line, size_t offset, CorpusBatch& batch) {
+    const string_view id_field = TakeField(line);
+    const string_view status_field = TakeField(line);
+    string_view ratings_field = TakeField(line);
+    if (id_field.data() == nullptr || status_field.data() == nullptr || ratings_field.data() == nullptr) {
+        ThrowMalformedLine(offset, "expected 4 tab-separated fields"s);
+    }
+
+    CorpusRecord record;
+    if (const auto id = ParseInt(id_field)) {
+        record.document_id = *id;
+    }
+    else {
+        ThrowMalformedLine(offset, "invalid document id"s);
+    }
+    if (const auto status = ParseStatus(status_field)) {
+        record.status = *status;
+    }
+    else {
+        ThrowMalformedLine(offset, "unknown status"s);
+    }
+
+    record.ratings_offset = batch.ratings.size();
+    while (!ratings_field.empty()) {
+        const size_t space = min(ratings_field.find(' '), ratings_field.size());
+        if (space > 0) {
+            const auto rating = ParseInt(ratings_field.substr(0, space));
+            if (!rating) {
+                ThrowMalformedLine(offset, "invalid rating"s);
+            }
+            batch.ratings.push_back(*rating);
+        }
+        ratings_field.remove_prefix(min(space + 1, ratings_field.size()));
+    }
+    record.ratings_count = batch.ratings.size() - record.ratings_offset;
+    record.text = line;
+    batch.records.push_back(record);
+}
+
+}  // namespace
+
+double CorpusStageStats::GetMegabytesPerSecond() const {
+    const double seconds = chrono::duration<double>(busy_time).count();
+    return seconds > 0 ? bytes / seconds / (1 << 20) : 0.0;
+}
+
+double CorpusStageStats::GetDocumentsPerSecond() const {
+    const double seconds = chrono::duration<double>(busy_time).count();
+    return seconds > 0 ? documents / seconds : 0.0;
+}
+
+ostream& operator<<(ostream& out, const CorpusLoadStats& stats) {
+    const auto print_stage = [&out](const string& name, const CorpusStageStats& stage) {
+        out << name << ": "s << stage.documents << " documents, "s << stage.bytes << " bytes, "s
+            << chrono::duration_cast<chrono::milliseconds>(stage.busy_time).count() << " ms busy, "s
+            << stage.GetMegabytesPerSecond() << " MB/s, "s << stage.GetDocumentsPerSecond() << " documents/s"s << endl;
+    };
+    print_stage("parse"s, stats.parse);
+    print_stage("index"s, stats.index);
+    out << "total: "s << chrono::duration_cast<chrono::milliseconds>(stats.total_time).count() << " ms"s << endl;
+    return out;
+}
+
+void ParseCorpusRecords(string_view text, size_t base_offset, CorpusBatch& batch) {
+    size_t position = 0;
+    while (position < text.size()) {
+        const size_t line_end = min(text.find('\n', position), text.size());
+        string_view line = text.substr(position, line_end - position);
+        if (!line.empty() && line.back() == '\r') {
+            line.remove_suffix(1);
+        }
+        if (!line.empty()) {
+            ParseLine(line, base_offset + position, batch);
+        }
+        position = line_end + 1;
+    }
+}
+
+vector<string_view> SplitCorpusIntoChunks(string_view text, size_t chunk_size) {
+    vector<string_view> chunks;
+    while (!text.empty()) {
+        size_t end = text.size();
+        if (chunk_size < text.size()) {
+            end = min(text.find('\n', max<size_t>(chunk_size, 1) - 1), text.size() - 1) + 1;
+        }
+        chunks.push_back(text.substr(0, end));
+        text.remove_prefix(end);
+    }
+    return chunks;
+}
+
+CorpusLoadStats LoadCorpus(SearchServer& search_server, const string& path, CorpusLoaderOptions options) {
+    using Clock = chrono::steady_clock;
+    const auto start_time = Clock::now();
+
+    MappedFile file(path);
+    file.AdviseSequential();
+    string_view corpus = file.View();
+    if (options.zero_copy) {
+        corpus = search_server.MapCorpus(move(file)).View();
+    }
+
+    const vector<string_view> chunks = SplitCorpusIntoChunks(corpus, options.chunk_size);
+    const size_t window = options.max_chunks_in_flight > 0 ? options.max_chunks_in_flight
+        : max<size_t>(thread::hardware_concurrency(), 1);
+
+    // chunks are parsed ahead on worker threads while the calling thread indexes them in order
+    deque<future<ParsedChunk>> in_flight;
+    size_t next_chunk = 0;
+    const auto launch_next = [&] {
+        const string_view chunk = chunks[next_chunk++];
+        const size_t offset = static_cast<size_t>(chunk.data() - corpus.data());
+        in_flight.push_back(async(launch::async, [chunk, offset] {
+            const auto parse_start = Clock::now();
+            ParsedChunk parsed;
+            parsed.bytes = chunk.size();
+            ParseCorpusRecords(chunk, offset, parsed.batch);
+            parsed.parse_time = Clock::now() - parse_start;
+            return parsed;
+        }));
+    };
+    while (next_chunk < chunks.size() && in_flight.size() < window) {
+        launch_next();
+    }
+
+    CorpusLoadStats stats;
+    vector<int> ratings;
+    while (!in_flight.empty()) {
+        const ParsedChunk parsed = in_flight.front().get();
+        in_flight.pop_front();
+        if (next_chunk < chunks.size()) {
+            launch_next();
+        }
+        stats.parse.documents += parsed.batch.records.size();
+        stats.parse.bytes += parsed.bytes;
+        stats.parse.busy_time += parsed.parse_time;
+
+        const auto index_start = Clock::now();
+        for (const CorpusRecord& record : parsed.batch.records) {
+            const auto record_ratings = parsed.batch.GetRatings(record);
+            ratings.assign(record_ratings.begin(), record_ratings.end());
+            if (options.zero_copy) {
+                search_server.AddDocument(record.document_id, StableText(record.text), record.status, ratings);
+            }
+            else {
+                search_server.AddDocument(record.document_id, record.text, record.status, ratings);
+            }
+        }
+        stats.index.documents += parsed.batch.records.size();
+        stats.index.bytes += parsed.bytes;
+        stats.index.busy_time += Clock::now() - index_start;
+    }
+
+    stats.total_time = Clock::now() - start_time;
+    return stats;
+}
@@ -0,0 +1,83 @@
+#pragma once
+
+#include "document.h"
+#include "search_server.h"
+
+#include <chrono>
+#include <cstddef>
+#include <iostream>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Corpus files hold one document per line: "id<TAB>status<TAB>ratings<TAB>text".
+// Status is ACTUAL, IRRELEVANT, BANNED or REMOVED, ratings are separated by spaces
+// and may be empty. Empty lines are skipped
+
+struct CorpusRecord {
+    int document_id = 0;
+    DocumentStatus status = DocumentStatus::ACTUAL;
+    // range of CorpusBatch::ratings
+    size_t ratings_offset = 0;
+    size_t ratings_count = 0;
+    std::string_view text;
+};
+
+// Records of one chunk of a corpus. Texts point into the corpus, ratings of all records
+// share one vector, so parsing a chunk allocates only when the vectors grow
+struct CorpusBatch {
+    std::vector<CorpusRecord> records;
+    std::vector<int> ratings;
+
+    std::span<const int> GetRatings(const CorpusRecord& record) const {
+        return {ratings.data() + record.ratings_offset, record.ratings_count};
+    }
+
+    void Clear() {
+        records.clear();
+        ratings.clear();
+    }
+};
+
+struct CorpusLoaderOptions {
+    // Chunks are cut at line boundaries, so real chunks may be slightly longer
+    size_t chunk_size = size_t(16) << 20;
+    // Parsed chunks waiting for the index, 0 means the number of hardware threads
+    size_t max_chunks_in_flight = 0;
+    // Index the texts in place, the corpus stays mapped for the lifetime of the server
+    bool zero_copy = false;
+};
+
+struct CorpusStageStats {
+    size_t documents = 0;
+    size_t bytes = 0;
+    // Summed over all the threads of the stage
+    std::chrono::nanoseconds busy_time{0};
+
+    double GetMegabytesPerSecond() const;
+
+    double GetDocumentsPerSecond() const;
+};
+
+struct CorpusLoadStats {
+    CorpusStageStats parse;
+    CorpusStageStats index;
+    std::chrono::nanoseconds total_time{0};
+};
+
+std::ostream& operator<<(std::ostream& out, const CorpusLoadStats& stats);
+
+// Appends the records of the lines in text to batch. base_offset is the position
+// of text in the corpus, used in error messages.
+// Throws std::invalid_argument on a malformed line
+void ParseCorpusRecords(std::string_view text, size_t base_offset, CorpusBatch& batch);
+
+// Splits text into pieces of about chunk_size bytes that end with a line break or the text end
+std::vector<std::string_view> SplitCorpusIntoChunks(std::string_view text, size_t chunk_size);
+
+// Memory-maps the corpus, parses its chunks on worker threads and adds the documents
+// to the server in file order from the calling thread.
+// Throws std::runtime_error if the file can't be mapped and std::invalid_argument
+// on a malformed line or a document the server rejects
+CorpusLoadStats LoadCorpus(SearchServer& search_server, const std::string& path, CorpusLoaderOptions options = {});
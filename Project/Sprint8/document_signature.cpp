@@ -0,0 +1,34 @@
+#include "document_signature.h"
+
+using namespace std;
+
+namespace {
+
+// splitmix64 finalizer
+uint64_t Mix(uint64_t value) {
+    value += 0x9e3779b97f4a7c15ull;
+    value = (value ^ (value >> 30)) * 0xbf58476d1ce4e5b9ull;
+    value = (value ^ (value >> 27)) * 0x94d049bb133111ebull;
+    return value ^ (value >> 31);
+}
+
+const uint64_t HIGH_SEED = 0x6a09e667f3bcc909ull;
+
+}  // namespace
+
+void DocumentSignature::Add(uint32_t word_id) {
+    low += HashWordId(word_id);
+    high += HashWordId(word_id, HIGH_SEED);
+}
+
+DocumentSignature ComputeSignature(span<const uint32_t> word_ids) {
+    DocumentSignature signature;
+    for (const uint32_t word_id : word_ids) {
+        signature.Add(word_id);
+    }
+    return signature;
+}
+
+uint64_t HashWordId(uint32_t word_id, uint64_t seed) {
+    return Mix(word_id ^ seed);
+}
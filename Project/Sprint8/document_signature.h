@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+
+// 128-bit fingerprint of a document's set of words.
+// The signature of a set is the sum of the hashes of its elements,
+// so it doesn't depend on the order in which the words are added
+struct DocumentSignature {
+    uint64_t low = 0;
+    uint64_t high = 0;
+
+    void Add(uint32_t word_id);
+
+    bool operator==(const DocumentSignature& other) const {
+        return low == other.low && high == other.high;
+    }
+
+    bool operator!=(const DocumentSignature& other) const {
+        return !(*this == other);
+    }
+
+    bool operator<(const DocumentSignature& other) const {
+        return low < other.low || (low == other.low && high < other.high);
+    }
+};
+
+// Word ids must be distinct
+DocumentSignature ComputeSignature(std::span<const uint32_t> word_ids);
+
+// Well-mixed 64-bit hash of a word id, different seeds give independent hash functions
+uint64_t HashWordId(uint32_t word_id, uint64_t seed = 0);
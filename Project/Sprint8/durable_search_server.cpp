@@ -0,0 +1,119 @@
+#include "durable_search_server.h"
+#include "snapshot.h"
+
+#include <filesystem>
+#include <stdexcept>
+
+using namespace std;
+
+DurableSearchServer::DurableSearchServer(const string& stop_words_text, const string& snapshot_path, const string& log_path,
+    SearchServerOptions options, WriteAheadLogOptions log_options)
+    : snapshot_path_(snapshot_path)
+    , server_(LoadOrCreate(stop_words_text, snapshot_path, options))
+    , last_sequence_number_(Recover(log_path))
+    , last_logged_sequence_number_(last_sequence_number_)
+    , log_(log_path, last_sequence_number_, log_options) {
+}
+
+void DurableSearchServer::AddDocument(int document_id, const string_view document, DocumentStatus status, const vector<int>& ratings) {
+    const LogRecord record = {0, LogOperation::ADD_DOCUMENT, document_id, status, ratings, string(document)};
+    // invalid text never reaches the log, the words point into record.text
+    PreparedDocument prepared = server_.PrepareDocument(document_id, record.text, status, ratings);
+    const uint64_t sequence_number = Log(record);
+    ApplyInOrder(sequence_number, [this, &prepared] {
+        server_.AddDocument(move(prepared));
+    });
+}
+
+void DurableSearchServer::RemoveDocument(int document_id) {
+    const uint64_t sequence_number = Log({0, LogOperation::REMOVE_DOCUMENT, document_id, DocumentStatus::ACTUAL, {}, {}});
+    ApplyInOrder(sequence_number, [this, document_id] {
+        server_.RemoveDocument(document_id);
+    });
+}
+
+void DurableSearchServer::Checkpoint() {
+    lock_guard guard(update_mutex_);
+    // the snapshot has to contain every record the truncation drops
+    log_.WaitDurable(last_logged_sequence_number_);
+    unique_lock lock(apply_mutex_);
+    applied_.wait(lock, [this] { return last_sequence_number_ == last_logged_sequence_number_; });
+    server_.SaveSnapshot(snapshot_path_, last_sequence_number_);
+    // a crash before truncation is harmless, the snapshot tells which records it contains
+    log_.Truncate();
+}
+
+const SearchServer& DurableSearchServer::GetSearchServer() const {
+    return server_;
+}
+
+uint64_t DurableSearchServer::GetLastSequenceNumber() const {
+    lock_guard guard(apply_mutex_);
+    return last_sequence_number_;
+}
+
+SearchServer DurableSearchServer::LoadOrCreate(const string& stop_words_text, const string& snapshot_path, SearchServerOptions options) {
+    if (filesystem::exists(snapshot_path)) {
+        return SearchServer::LoadSnapshot(snapshot_path);
+    }
+    return SearchServer(stop_words_text, options);
+}
+
+uint64_t DurableSearchServer::Recover(const string& log_path) {
+    uint64_t last_sequence_number = 0;
+    if (filesystem::exists(snapshot_path_)) {
+        last_sequence_number = ReadSnapshotInfo(snapshot_path_).log_sequence_number;
+    }
+
+    WriteAheadLog::Read(log_path, [this, &last_sequence_number](const LogRecord& record) {
+        if (record.sequence_number > last_sequence_number) {
+            Apply(record);
+            last_sequence_number = record.sequence_number;
+        }
+    });
+    return last_sequence_number;
+}
+
+void DurableSearchServer::Apply(const LogRecord& record) {
+    if (record.operation == LogOperation::ADD_DOCUMENT) {
+        try {
+            server_.AddDocument(record.document_id, record.text, record.status, record.ratings);
+        } catch (const invalid_argument&) {
+        }
+    }
+    else {
+        server_.RemoveDocument(record.document_id);
+    }
+}
+
+uint64_t DurableSearchServer::Log(const LogRecord& record) {
+    uint64_t sequence_number = 0;
+    {
+        lock_guard guard(update_mutex_);
+        sequence_number = log_.Enqueue(record);
+        last_logged_sequence_number_ = sequence_number;
+    }
+    try {
+        log_.WaitDurable(sequence_number);
+    } catch (...) {
+        // the record is lost, it counts as applied so that later updates and checkpoints don't wait for it
+        ApplyInOrder(sequence_number, [] {});
+        throw;
+    }
+    return sequence_number;
+}
+
+void DurableSearchServer::ApplyInOrder(uint64_t sequence_number, const function<void()>& update) {
+    unique_lock lock(apply_mutex_);
+    applied_.wait(lock, [this, sequence_number] { return last_sequence_number_ + 1 == sequence_number; });
+    // a rejected update still counts as applied, replay rejects it as well
+    try {
+        update();
+    } catch (...) {
+        last_sequence_number_ = sequence_number;
+        applied_.notify_all();
+        throw;
+    }
+    last_sequence_number_ = sequence_number;
+    applied_.notify_all();
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include "search_server.h"
+#include "write_ahead_log.h"
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// SearchServer whose updates survive a crash: every update is written to the write-ahead log
+// before it is applied, and startup replays the log on top of the last snapshot
+class DurableSearchServer {
+public:
+    DurableSearchServer(const std::string& stop_words_text, const std::string& snapshot_path, const std::string& log_path,
+        SearchServerOptions options = {}, WriteAheadLogOptions log_options = {});
+
+    // Updates may come from several threads. Each call applies its update once the record is on disk,
+    // in log order, so a failed write leaves the index untouched. An update the index rejects, e.g.
+    // a used id, stays in the log and is rejected the same way on replay
+    void AddDocument(int document_id, const std::string_view document, DocumentStatus status, const std::vector<int>& ratings);
+
+    void RemoveDocument(int document_id);
+
+    // Saves a snapshot of the index and empties the log
+    void Checkpoint();
+
+    // Queries must not run concurrently with updates
+    const SearchServer& GetSearchServer() const;
+
+    uint64_t GetLastSequenceNumber() const;
+
+private:
+    static SearchServer LoadOrCreate(const std::string& stop_words_text, const std::string& snapshot_path, SearchServerOptions options);
+
+    uint64_t Recover(const std::string& log_path);
+
+    // Skips records the index rejected when they were first applied
+    void Apply(const LogRecord& record);
+
+    // Writes the record and waits until it is on disk, returns its sequence number.
+    // A record the log fails to write is passed over by ApplyInOrder
+    uint64_t Log(const LogRecord& record);
+
+    // Runs update once the records before sequence_number are applied
+    void ApplyInOrder(uint64_t sequence_number, const std::function<void()>& update);
+
+    std::string snapshot_path_;
+    SearchServer server_;
+    // The last record applied, rejected by the index or lost by the log
+    uint64_t last_sequence_number_ = 0;
+    mutable std::mutex apply_mutex_;
+    std::condition_variable applied_;
+    // The last record handed to the log, checkpoints hold the mutex to keep new records out
+    uint64_t last_logged_sequence_number_ = 0;
+    std::mutex update_mutex_;
+    WriteAheadLog log_;
+};
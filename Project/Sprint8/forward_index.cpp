@@ -0,0 +1,63 @@
+#include "forward_index.h"
+
+#include <algorithm>
+
+using namespace std;
+
+void ForwardIndex::Add(int document_id, vector<Entry> entries) {
+    sort(entries.begin(), entries.end(),
+        [](const Entry& lhs, const Entry& rhs) { return lhs.word_id < rhs.word_id; });
+
+    offsets_[document_id] = {entries_.size(), static_cast<uint32_t>(entries.size())};
+    entries_.insert(entries_.end(), entries.begin(), entries.end());
+}
+
+size_t ForwardIndex::Remove(int document_id) {
+    auto it = offsets_.find(document_id);
+    if (it == offsets_.end()) {
+        return 0;
+    }
+
+    dead_entries_ += it->second.size;
+    offsets_.erase(it);
+
+    // compact once the holes outweigh the live entries
+    if (dead_entries_ * 2 > entries_.size()) {
+        return Compact();
+    }
+    return 0;
+}
+
+bool ForwardIndex::Contains(int document_id) const {
+    return offsets_.count(document_id) > 0;
+}
+
+span<const ForwardIndex::Entry> ForwardIndex::Get(int document_id) const {
+    auto it = offsets_.find(document_id);
+    if (it == offsets_.end()) {
+        return {};
+    }
+    return {entries_.data() + it->second.offset, it->second.size};
+}
+
+size_t ForwardIndex::Compact() {
+    const size_t capacity_before = entries_.capacity();
+
+    vector<Entry> compacted;
+    compacted.reserve(entries_.size() - dead_entries_);
+    for (auto& [document_id, range] : offsets_) {
+        const size_t offset = compacted.size();
+        compacted.insert(compacted.end(), entries_.begin() + range.offset, entries_.begin() + range.offset + range.size);
+        range.offset = offset;
+    }
+
+    entries_.swap(compacted);
+    dead_entries_ = 0;
+
+    return (capacity_before - entries_.capacity()) * sizeof(Entry);
+}
+
+size_t ForwardIndex::GetMemoryUsage() const {
+    return entries_.capacity() * sizeof(Entry)
+        + offsets_.size() * (TREE_NODE_OVERHEAD + sizeof(pair<const int, Range>));
+}
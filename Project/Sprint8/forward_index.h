@@ -0,0 +1,122 @@
+#pragma once
+
+#include <cstdint>
+#include <iterator>
+#include <map>
+#include <span>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+// Per-document list of (word id, term frequency) pairs.
+// All documents share one contiguous buffer, an offsets table maps document id to its slice
+class ForwardIndex {
+public:
+    struct Entry {
+        uint32_t word_id = 0;
+        float term_freq = 0.0f;
+    };
+
+    // Entries are stored sorted by word id
+    void Add(int document_id, std::vector<Entry> entries);
+
+    // Returns the number of bytes released if the removal triggered compaction
+    size_t Remove(int document_id);
+
+    bool Contains(int document_id) const;
+
+    std::span<const Entry> Get(int document_id) const;
+
+    // Moves live entries to the front of the buffer and releases unused capacity
+    size_t Compact();
+
+    size_t GetMemoryUsage() const;
+
+private:
+    struct Range {
+        size_t offset = 0;
+        uint32_t size = 0;
+    };
+
+    static constexpr size_t TREE_NODE_OVERHEAD = 4 * sizeof(void*);
+
+    std::vector<Entry> entries_;
+    std::map<int, Range> offsets_;
+    size_t dead_entries_ = 0;
+};
+
+// Lightweight read-only view over the forward index entries of one document.
+// Yields (word, term frequency) pairs ordered by word id
+class WordFrequenciesView {
+public:
+    class Iterator {
+    public:
+        using iterator_category = std::input_iterator_tag;
+        using value_type = std::pair<std::string_view, double>;
+        using difference_type = std::ptrdiff_t;
+        using pointer = void;
+        using reference = value_type;
+
+        Iterator() = default;
+
+        Iterator(const ForwardIndex::Entry* entry, const std::vector<std::string_view>* words)
+            : entry_(entry), words_(words) { }
+
+        value_type operator*() const {
+            return {(*words_)[entry_->word_id], entry_->term_freq};
+        }
+
+        Iterator& operator++() {
+            ++entry_;
+            return *this;
+        }
+
+        Iterator operator++(int) {
+            Iterator old = *this;
+            ++entry_;
+            return old;
+        }
+
+        bool operator==(const Iterator& other) const {
+            return entry_ == other.entry_;
+        }
+
+        bool operator!=(const Iterator& other) const {
+            return entry_ != other.entry_;
+        }
+
+    private:
+        const ForwardIndex::Entry* entry_ = nullptr;
+        const std::vector<std::string_view>* words_ = nullptr;
+    };
+
+    WordFrequenciesView() = default;
+
+    WordFrequenciesView(std::span<const ForwardIndex::Entry> entries, const std::vector<std::string_view>& words)
+        : entries_(entries), words_(&words) { }
+
+    Iterator begin() const {
+        return {entries_.data(), words_};
+    }
+
+    Iterator end() const {
+        return {entries_.data() + entries_.size(), words_};
+    }
+
+    size_t size() const {
+        return entries_.size();
+    }
+
+    bool empty() const {
+        return entries_.empty();
+    }
+
+    // Raw (word id, term frequency) pairs
+    std::span<const ForwardIndex::Entry> entries() const {
+        return entries_;
+    }
+
+private:
+    std::span<const ForwardIndex::Entry> entries_;
+    const std::vector<std::string_view>* words_ = nullptr;
+};
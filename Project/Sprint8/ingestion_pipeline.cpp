@@ -0,0 +1,317 @@
+#include "bounded_queue.h"
+#include "ingestion_pipeline.h"
+#include "mapped_file.h"
+
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+namespace {
+
+using Clock = chrono::steady_clock;
+
+struct ParsedBatch {
+    CorpusBatch batch;
+    size_t bytes = 0;
+};
+
+struct PreparedBatch {
+    vector<PreparedDocument> documents;
+    size_t bytes = 0;
+};
+
+// Spins briefly, then sleeps, so idle stages don't burn the cores the busy ones need
+class Backoff {
+public:
+    void Wait() {
+        if (++attempts_ < SPIN_LIMIT) {
+            this_thread::yield();
+        }
+        else {
+            this_thread::sleep_for(chrono::microseconds(50));
+        }
+    }
+
+private:
+    static constexpr int SPIN_LIMIT = 64;
+    int attempts_ = 0;
+};
+
+// Stage counters updated by several threads
+class StageCounters {
+public:
+    void Add(size_t documents, size_t bytes, Clock::duration busy_time) {
+        documents_ += documents;
+        bytes_ += bytes;
+        busy_ns_ += chrono::duration_cast<chrono::nanoseconds>(busy_time).count();
+    }
+
+    CorpusStageStats GetStats() const {
+        CorpusStageStats stats;
+        stats.documents = documents_;
+        stats.bytes = bytes_;
+        stats.busy_time = chrono::nanoseconds(busy_ns_.load());
+        return stats;
+    }
+
+private:
+    atomic<size_t> documents_ = 0;
+    atomic<size_t> bytes_ = 0;
+    atomic<int64_t> busy_ns_ = 0;
+};
+
+// Queue between two stages. The consumers finish when every producer has closed
+// its end and the queue is drained, everybody stops as soon as the pipeline fails
+template <typename T>
+class Channel {
+public:
+    Channel(size_t capacity, size_t producer_count, const atomic<bool>& failed)
+        : queue_(capacity), producers_left_(producer_count), failed_(failed) {
+    }
+
+    // Blocks while the queue is full, returns false if the pipeline failed
+    bool Push(T& value) {
+        Backoff backoff;
+        bool waited = false;
+        while (!queue_.TryPush(value)) {
+            if (failed_) {
+                return false;
+            }
+            if (!waited) {
+                ++full_waits_;
+                waited = true;
+            }
+            backoff.Wait();
+        }
+        return true;
+    }
+
+    // Returns false when there is nothing left to consume
+    bool Pop(T& value) {
+        Backoff backoff;
+        bool waited = false;
+        for (;;) {
+            const size_t depth = queue_.GetSize();
+            if (queue_.TryPop(value)) {
+                RecordDepth(depth);
+                return true;
+            }
+            if (failed_) {
+                return false;
+            }
+            if (producers_left_.load(memory_order_acquire) == 0) {
+                // a producer may have pushed right before closing
+                return queue_.TryPop(value);
+            }
+            if (!waited) {
+                ++empty_waits_;
+                waited = true;
+            }
+            backoff.Wait();
+        }
+    }
+
+    void CloseProducer() {
+        producers_left_.fetch_sub(1, memory_order_release);
+    }
+
+    QueueStats GetStats() const {
+        QueueStats stats;
+        stats.capacity = queue_.GetCapacity();
+        stats.max_depth = max_depth_;
+        stats.average_depth = pops_ > 0 ? static_cast<double>(depth_sum_) / pops_ : 0.0;
+        stats.full_waits = full_waits_;
+        stats.empty_waits = empty_waits_;
+        return stats;
+    }
+
+private:
+    void RecordDepth(size_t depth) {
+        depth_sum_ += depth;
+        ++pops_;
+        size_t max_depth = max_depth_.load(memory_order_relaxed);
+        while (depth > max_depth && !max_depth_.compare_exchange_weak(max_depth, depth, memory_order_relaxed)) {
+        }
+    }
+
+    BoundedQueue<T> queue_;
+    atomic<size_t> producers_left_;
+    const atomic<bool>& failed_;
+    atomic<size_t> max_depth_ = 0;
+    atomic<size_t> depth_sum_ = 0;
+    atomic<size_t> pops_ = 0;
+    atomic<size_t> full_waits_ = 0;
+    atomic<size_t> empty_waits_ = 0;
+};
+
+// Keeps the first error and stops the other stages
+class FailureState {
+public:
+    void Fail(exception_ptr error) {
+        lock_guard guard(mutex_);
+        if (!error_) {
+            error_ = error;
+        }
+        failed_ = true;
+    }
+
+    const atomic<bool>& GetFlag() const {
+        return failed_;
+    }
+
+    void Rethrow() const {
+        if (error_) {
+            rethrow_exception(error_);
+        }
+    }
+
+private:
+    mutex mutex_;
+    exception_ptr error_;
+    atomic<bool> failed_ = false;
+};
+
+void PrintQueue(ostream& out, const string& name, const QueueStats& queue) {
+    out << name << " queue: capacity "s << queue.capacity << ", max depth "s << queue.max_depth
+        << ", average depth "s << queue.average_depth << ", full waits "s << queue.full_waits
+        << ", empty waits "s << queue.empty_waits << endl;
+}
+
+void PrintStage(ostream& out, const string& name, const CorpusStageStats& stage) {
+    out << name << ": "s << stage.documents << " documents, "s
+        << chrono::duration_cast<chrono::milliseconds>(stage.busy_time).count() << " ms busy, "s
+        << stage.GetMegabytesPerSecond() << " MB/s, "s << stage.GetDocumentsPerSecond() << " documents/s"s << endl;
+}
+
+}  // namespace
+
+ostream& operator<<(ostream& out, const IngestionStats& stats) {
+    PrintStage(out, "read"s, stats.read);
+    PrintQueue(out, "parsed"s, stats.parsed_queue);
+    PrintStage(out, "tokenize"s, stats.tokenize);
+    PrintQueue(out, "prepared"s, stats.prepared_queue);
+    PrintStage(out, "index"s, stats.index);
+    out << "total: "s << chrono::duration_cast<chrono::milliseconds>(stats.total_time).count() << " ms"s << endl;
+    return out;
+}
+
+IngestionStats RunIngestionPipeline(SearchServer& search_server, const string& path, IngestionOptions options) {
+    const auto start_time = Clock::now();
+
+    MappedFile file(path);
+    file.AdviseSequential();
+    string_view corpus = file.View();
+    if (options.zero_copy) {
+        corpus = search_server.MapCorpus(move(file)).View();
+    }
+    const vector<string_view> chunks = SplitCorpusIntoChunks(corpus, options.chunk_size);
+
+    const size_t read_threads = max<size_t>(options.read_threads, 1);
+    const size_t tokenize_threads = options.tokenize_threads > 0 ? options.tokenize_threads
+        : max<size_t>(thread::hardware_concurrency(), 1);
+
+    FailureState failure;
+    Channel<ParsedBatch> parsed(options.parsed_queue_capacity, read_threads, failure.GetFlag());
+    Channel<PreparedBatch> prepared(options.prepared_queue_capacity, tokenize_threads, failure.GetFlag());
+    StageCounters read_counters;
+    StageCounters tokenize_counters;
+    StageCounters index_counters;
+
+    atomic<size_t> next_chunk = 0;
+    const auto read = [&] {
+        try {
+            for (size_t index = next_chunk++; index < chunks.size(); index = next_chunk++) {
+                const auto busy_start = Clock::now();
+                ParsedBatch batch;
+                batch.bytes = chunks[index].size();
+                ParseCorpusRecords(chunks[index], chunks[index].data() - corpus.data(), batch.batch);
+                read_counters.Add(batch.batch.records.size(), batch.bytes, Clock::now() - busy_start);
+                if (!parsed.Push(batch)) {
+                    break;
+                }
+            }
+        } catch (...) {
+            failure.Fail(current_exception());
+        }
+        parsed.CloseProducer();
+    };
+
+    const auto tokenize = [&] {
+        try {
+            ParsedBatch batch;
+            vector<int> ratings;
+            while (parsed.Pop(batch)) {
+                const auto busy_start = Clock::now();
+                PreparedBatch result;
+                result.bytes = batch.bytes;
+                result.documents.reserve(batch.batch.records.size());
+                for (const CorpusRecord& record : batch.batch.records) {
+                    const auto record_ratings = batch.batch.GetRatings(record);
+                    ratings.assign(record_ratings.begin(), record_ratings.end());
+                    if (options.zero_copy) {
+                        result.documents.push_back(search_server.PrepareDocument(record.document_id, StableText(record.text),
+                            record.status, ratings));
+                    }
+                    else {
+                        result.documents.push_back(search_server.PrepareDocument(record.document_id, record.text,
+                            record.status, ratings));
+                    }
+                }
+                tokenize_counters.Add(result.documents.size(), result.bytes, Clock::now() - busy_start);
+                if (!prepared.Push(result)) {
+                    break;
+                }
+            }
+        } catch (...) {
+            failure.Fail(current_exception());
+        }
+        prepared.CloseProducer();
+    };
+
+    // AddDocument(PreparedDocument) may be called from several threads
+    const auto index = [&] {
+        try {
+            PreparedBatch batch;
+            while (prepared.Pop(batch)) {
+                const auto busy_start = Clock::now();
+                for (PreparedDocument& document : batch.documents) {
+                    search_server.AddDocument(move(document));
+                }
+                index_counters.Add(batch.documents.size(), batch.bytes, Clock::now() - busy_start);
+            }
+        } catch (...) {
+            failure.Fail(current_exception());
+        }
+    };
+
+    vector<thread> workers;
+    for (size_t i = 0; i < read_threads; ++i) {
+        workers.emplace_back(read);
+    }
+    for (size_t i = 0; i < tokenize_threads; ++i) {
+        workers.emplace_back(tokenize);
+    }
+    for (size_t i = 1; i < options.index_threads; ++i) {
+        workers.emplace_back(index);
+    }
+    index();
+
+    for (thread& worker : workers) {
+        worker.join();
+    }
+    failure.Rethrow();
+
+    IngestionStats stats;
+    stats.read = read_counters.GetStats();
+    stats.tokenize = tokenize_counters.GetStats();
+    stats.index = index_counters.GetStats();
+    stats.parsed_queue = parsed.GetStats();
+    stats.prepared_queue = prepared.GetStats();
+    stats.total_time = Clock::now() - start_time;
+    return stats;
+}
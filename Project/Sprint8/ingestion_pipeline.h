@@ -0,0 +1,59 @@
+#pragma once
+
+#include "corpus_loader.h"
+#include "search_server.h"
+
+#include <chrono>
+#include <cstddef>
+#include <iostream>
+#include <string>
+
+// Ingestion of a corpus file (see corpus_loader.h for the format) in three stages
+// connected by bounded lock-free queues:
+//   read     - cuts the mapped file into chunks and parses records,
+//   tokenize - splits texts into words, validates them and computes term frequencies,
+//   index    - adds the prepared documents to the server on the calling thread and index_threads - 1 more.
+// A full queue blocks the stage feeding it, so a slow index throttles reading and tokenizing.
+// Documents of different chunks may be indexed in any order
+
+struct IngestionOptions {
+    size_t chunk_size = size_t(4) << 20;
+    size_t read_threads = 1;
+    // 0 means the number of hardware threads
+    size_t tokenize_threads = 0;
+    // Indexers share the server through the concurrent AddDocument. Words of one document are
+    // added under striped locks, so more indexers pay off while documents rarely share words,
+    // and a duplicate policy other than ALLOW serializes them anyway
+    size_t index_threads = 1;
+    // Capacities of the queues in batches, one batch per chunk
+    size_t parsed_queue_capacity = 8;
+    size_t prepared_queue_capacity = 8;
+    // Index the texts in place, the corpus stays mapped for the lifetime of the server
+    bool zero_copy = false;
+};
+
+struct QueueStats {
+    size_t capacity = 0;
+    size_t max_depth = 0;
+    // Depth seen by consumers at each pop
+    double average_depth = 0.0;
+    // Pushes that found the queue full, i.e. back-pressure on the producing stage
+    size_t full_waits = 0;
+    // Pops that found the queue empty, i.e. the consuming stage was starved
+    size_t empty_waits = 0;
+};
+
+struct IngestionStats {
+    CorpusStageStats read;
+    CorpusStageStats tokenize;
+    CorpusStageStats index;
+    QueueStats parsed_queue;
+    QueueStats prepared_queue;
+    std::chrono::nanoseconds total_time{0};
+};
+
+std::ostream& operator<<(std::ostream& out, const IngestionStats& stats);
+
+// Throws std::runtime_error if the file can't be mapped and std::invalid_argument on
+// a malformed line or a document the server rejects, the first error stops all the stages
+IngestionStats RunIngestionPipeline(SearchServer& search_server, const std::string& path, IngestionOptions options = {});
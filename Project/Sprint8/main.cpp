@@ -1,3 +1,5 @@
+#include "corpus_loader.h"
+#include "network_server.h"
 #include "process_queries.h"
 #include "search_server.h"
 
@@ -15,7 +17,28 @@ void PrintDocument(const Document& document) {
          << "rating = "s << document.rating << " }"s << endl;
 }
 
-int main() {
+// serve <corpus> [port] [stop words]: indexes a tab-separated corpus and answers queries over the network
+int Serve(int argc, char* argv[]) {
+    if (argc < 3) {
+        cerr << "Usage: "s << argv[0] << " serve <corpus> [port] [stop words]"s << endl;
+        return 1;
+    }
+    SearchServer search_server(argc > 4 ? string(argv[4]) : ""s);
+    cerr << LoadCorpus(search_server, argv[2]) << endl;
+
+    NetworkServerOptions options;
+    options.port = static_cast<uint16_t>(argc > 3 ? stoi(argv[3]) : 8080);
+    NetworkServer network_server(search_server, options);
+    cerr << "Listening on "s << options.address << ":"s << network_server.GetPort() << endl;
+    network_server.Run();
+    return 0;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc > 1 && argv[1] == "serve"s) {
+        return Serve(argc, argv);
+    }
+
     SearchServer search_server("and with"s);
 
     int id = 0;
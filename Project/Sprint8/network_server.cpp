@@ -0,0 +1,690 @@
+#include "network_server.h"
+#include "process_queries.h"
+
+#include <algorithm>
+#include <bit>
+#include <cerrno>
+#include <cctype>
+#include <charconv>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+
+#include <arpa/inet.h>
+#include <endian.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+using namespace std;
+
+namespace {
+
+const uint64_t LISTEN_ID = 0;
+const uint64_t WAKE_ID = UINT64_MAX;
+const size_t FRAME_SIZE_BYTES = sizeof(uint32_t);
+
+void AppendUint32(string& out, uint32_t value) {
+    value = htobe32(value);
+    out.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+void AppendUint64(string& out, uint64_t value) {
+    value = htobe64(value);
+    out.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+template <typename T>
+T TakeBigEndian(string_view& in) {
+    T value = 0;
+    if (in.size() < sizeof(value)) {
+        throw runtime_error("Network response is truncated"s);
+    }
+    memcpy(&value, in.data(), sizeof(value));
+    in.remove_prefix(sizeof(value));
+    if constexpr (sizeof(T) == sizeof(uint32_t)) {
+        return be32toh(value);
+    }
+    else {
+        return be64toh(value);
+    }
+}
+
+string EncodeBinaryResponse(const vector<Document>* documents, const string& error) {
+    string payload;
+    if (documents != nullptr) {
+        payload += static_cast<char>(NetworkResponseStatus::OK);
+        AppendUint32(payload, static_cast<uint32_t>(documents->size()));
+        for (const Document& document : *documents) {
+            AppendUint32(payload, static_cast<uint32_t>(document.id));
+            AppendUint64(payload, bit_cast<uint64_t>(document.relevance));
+            AppendUint32(payload, static_cast<uint32_t>(document.rating));
+        }
+    }
+    else {
+        payload += static_cast<char>(NetworkResponseStatus::INVALID_QUERY);
+        payload += error;
+    }
+    string frame;
+    AppendUint32(frame, static_cast<uint32_t>(payload.size()));
+    return frame + payload;
+}
+
+void AppendJsonString(string& out, string_view text) {
+    out += '"';
+    for (const char c : text) {
+        if (c == '"' || c == '\\') {
+            out += '\\';
+            out += c;
+        }
+        else if (static_cast<unsigned char>(c) < 0x20) {
+            char escaped[8];
+            snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+            out += escaped;
+        }
+        else {
+            out += c;
+        }
+    }
+    out += '"';
+}
+
+template <typename Number>
+void AppendNumber(string& out, Number value) {
+    char buffer[32];
+    const auto result = to_chars(buffer, buffer + sizeof(buffer), value);
+    out.append(buffer, result.ptr);
+}
+
+string MakeHttpResponse(int code, string_view reason, string_view body, bool close) {
+    string response = "HTTP/1.1 "s;
+    AppendNumber(response, code);
+    response += ' ';
+    response += reason;
+    response += "\r\nContent-Type: application/json\r\nContent-Length: "s;
+    AppendNumber(response, body.size());
+    response += close ? "\r\nConnection: close\r\n\r\n"s : "\r\n\r\n"s;
+    response += body;
+    return response;
+}
+
+string MakeHttpError(int code, string_view reason, string_view message, bool close) {
+    string body = "{\"error\":"s;
+    AppendJsonString(body, message);
+    body += '}';
+    return MakeHttpResponse(code, reason, body, close);
+}
+
+string EncodeHttpResponse(const vector<Document>* documents, const string& error, bool close) {
+    if (documents == nullptr) {
+        return MakeHttpError(400, "Bad Request"sv, error, close);
+    }
+    string body = "{\"documents\":["s;
+    for (const Document& document : *documents) {
+        body += body.back() == '[' ? "{\"id\":"s : ",{\"id\":"s;
+        AppendNumber(body, document.id);
+        body += ",\"relevance\":"s;
+        AppendNumber(body, document.relevance);
+        body += ",\"rating\":"s;
+        AppendNumber(body, document.rating);
+        body += '}';
+    }
+    body += "]}"s;
+    return MakeHttpResponse(200, "OK"sv, body, close);
+}
+
+string ToLower(string_view text) {
+    string result(text);
+    transform(result.begin(), result.end(), result.begin(), [](unsigned char c) { return tolower(c); });
+    return result;
+}
+
+string_view Trim(string_view text) {
+    while (!text.empty() && (text.front() == ' ' || text.front() == '\t')) {
+        text.remove_prefix(1);
+    }
+    while (!text.empty() && (text.back() == ' ' || text.back() == '\t')) {
+        text.remove_suffix(1);
+    }
+    return text;
+}
+
+// Decodes %XX and '+' of a query string component, nullopt if an escape is malformed
+optional<string> DecodeUrlComponent(string_view text) {
+    string result;
+    for (size_t i = 0; i < text.size(); ++i) {
+        if (text[i] == '+') {
+            result += ' ';
+        }
+        else if (text[i] == '%') {
+            int value = 0;
+            if (i + 2 >= text.size() || !isxdigit(static_cast<unsigned char>(text[i + 1]))
+                || !isxdigit(static_cast<unsigned char>(text[i + 2]))) {
+                return nullopt;
+            }
+            from_chars(text.data() + i + 1, text.data() + i + 3, value, 16);
+            result += static_cast<char>(value);
+            i += 2;
+        }
+        else {
+            result += text[i];
+        }
+    }
+    return result;
+}
+
+void WakeUp(int fd) {
+    const uint64_t one = 1;
+    // a counter that is already non-zero wakes the loop just as well
+    [[maybe_unused]] const ssize_t result = write(fd, &one, sizeof(one));
+}
+
+}  // namespace
+
+string EncodeNetworkRequest(string_view query) {
+    string frame;
+    AppendUint32(frame, static_cast<uint32_t>(query.size()));
+    frame += query;
+    return frame;
+}
+
+size_t GetNetworkFrameSize(string_view data) {
+    if (data.size() < FRAME_SIZE_BYTES) {
+        return 0;
+    }
+    return FRAME_SIZE_BYTES + TakeBigEndian<uint32_t>(data);
+}
+
+NetworkResponse DecodeNetworkResponse(string_view frame) {
+    if (GetNetworkFrameSize(frame) != frame.size() || frame.size() <= FRAME_SIZE_BYTES) {
+        throw runtime_error("Network response frame is incomplete"s);
+    }
+    frame.remove_prefix(FRAME_SIZE_BYTES);
+    NetworkResponse response;
+    response.status = static_cast<NetworkResponseStatus>(frame[0]);
+    frame.remove_prefix(1);
+    if (response.status == NetworkResponseStatus::INVALID_QUERY) {
+        response.error = frame;
+        return response;
+    }
+    if (response.status != NetworkResponseStatus::OK) {
+        throw runtime_error("Unknown network response status"s);
+    }
+    const uint32_t count = TakeBigEndian<uint32_t>(frame);
+    for (uint32_t i = 0; i < count; ++i) {
+        const int id = static_cast<int32_t>(TakeBigEndian<uint32_t>(frame));
+        const double relevance = bit_cast<double>(TakeBigEndian<uint64_t>(frame));
+        response.documents.emplace_back(id, relevance, static_cast<int32_t>(TakeBigEndian<uint32_t>(frame)));
+    }
+    if (!frame.empty()) {
+        throw runtime_error("Network response has trailing bytes"s);
+    }
+    return response;
+}
+
+NetworkServer::NetworkServer(const SearchServer& search_server, NetworkServerOptions options)
+    : search_server_(search_server), options_(move(options)) {
+    if (options_.max_batch_size == 0 || options_.max_pipelined_requests == 0) {
+        throw invalid_argument("Batch size and pipelining limit must be positive"s);
+    }
+    sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(options_.port);
+    if (inet_pton(AF_INET, options_.address.c_str(), &address.sin_addr) != 1) {
+        throw invalid_argument("Invalid IPv4 address "s + options_.address);
+    }
+
+    listen_fd_ = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+    wake_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    const int reuse = 1;
+    socklen_t address_size = sizeof(address);
+    epoll_event listen_event = {EPOLLIN, {.u64 = LISTEN_ID}};
+    epoll_event wake_event = {EPOLLIN, {.u64 = WAKE_ID}};
+    if (listen_fd_ < 0 || epoll_fd_ < 0 || wake_fd_ < 0
+        || setsockopt(listen_fd_, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse)) != 0
+        || bind(listen_fd_, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0
+        || listen(listen_fd_, SOMAXCONN) != 0
+        || getsockname(listen_fd_, reinterpret_cast<sockaddr*>(&address), &address_size) != 0
+        || epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, listen_fd_, &listen_event) != 0
+        || epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, wake_fd_, &wake_event) != 0) {
+        const string error = strerror(errno);
+        for (const int fd : {listen_fd_, epoll_fd_, wake_fd_}) {
+            if (fd >= 0) {
+                close(fd);
+            }
+        }
+        throw runtime_error("Can't listen on "s + options_.address + ": "s + error);
+    }
+    port_ = ntohs(address.sin_port);
+}
+
+NetworkServer::~NetworkServer() {
+    close(listen_fd_);
+    close(epoll_fd_);
+    close(wake_fd_);
+}
+
+uint16_t NetworkServer::GetPort() const {
+    return port_;
+}
+
+void NetworkServer::Stop() {
+    stopping_ = true;
+    WakeUp(wake_fd_);
+}
+
+NetworkServerStats NetworkServer::GetStats() const {
+    NetworkServerStats stats;
+    stats.connections = connection_count_;
+    stats.requests = request_count_;
+    stats.http_requests = http_request_count_;
+    stats.batches = batch_count_;
+    return stats;
+}
+
+void NetworkServer::Run() {
+    const size_t worker_count = options_.worker_threads != 0 ? options_.worker_threads : max(thread::hardware_concurrency(), 1u);
+    for (size_t i = 0; i < worker_count; ++i) {
+        workers_.emplace_back([this] { WorkerLoop(); });
+    }
+
+    string error;
+    epoll_event events[64];
+    vector<Request> requests;
+    vector<uint64_t> touched;
+    while (!stopping_) {
+        const int count = epoll_wait(epoll_fd_, events, size(events), -1);
+        if (count < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            error = strerror(errno);
+            break;
+        }
+
+        // everything read in this iteration is dispatched together
+        requests.clear();
+        touched.clear();
+        for (int i = 0; i < count; ++i) {
+            const uint64_t id = events[i].data.u64;
+            if (id == LISTEN_ID) {
+                Accept();
+                continue;
+            }
+            if (id == WAKE_ID) {
+                uint64_t value = 0;
+                [[maybe_unused]] const ssize_t result = read(wake_fd_, &value, sizeof(value));
+                continue;
+            }
+            const auto it = connections_.find(id);
+            if (it == connections_.end()) {
+                continue;
+            }
+            if ((events[i].events & (EPOLLHUP | EPOLLERR)) != 0
+                || ((events[i].events & EPOLLIN) != 0 && !Read(id, it->second, requests))) {
+                CloseConnection(id);
+                continue;
+            }
+            touched.push_back(id);
+        }
+        TakeCompletions(touched);
+        for (const uint64_t id : touched) {
+            Update(id, requests);
+        }
+        Dispatch(requests);
+    }
+
+    {
+        lock_guard guard(batches_mutex_);
+        workers_stopping_ = true;
+    }
+    has_batches_.notify_all();
+    for (thread& worker : workers_) {
+        worker.join();
+    }
+    workers_.clear();
+    while (!connections_.empty()) {
+        CloseConnection(connections_.begin()->first);
+    }
+    if (!error.empty()) {
+        throw runtime_error("Event loop failed: "s + error);
+    }
+}
+
+void NetworkServer::Accept() {
+    for (;;) {
+        const int fd = accept4(listen_fd_, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            // EAGAIN ends the backlog, other errors concern only the connection being accepted
+            if (errno == EINTR || errno == ECONNABORTED) {
+                continue;
+            }
+            return;
+        }
+        const int no_delay = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &no_delay, sizeof(no_delay));
+
+        const uint64_t id = next_connection_id_++;
+        epoll_event event = {EPOLLIN, {.u64 = id}};
+        if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &event) != 0) {
+            close(fd);
+            continue;
+        }
+        Connection& connection = connections_[id];
+        connection.fd = fd;
+        connection.events = EPOLLIN;
+        ++connection_count_;
+    }
+}
+
+bool NetworkServer::Read(uint64_t connection_id, Connection& connection, vector<Request>& requests) {
+    char buffer[1 << 16];
+    for (;;) {
+        if (!ParseRequests(connection_id, connection, requests)) {
+            return false;
+        }
+        // the rest stays in the socket until the client takes its answers
+        if (connection.read_closed || connection.close_after_responses
+            || connection.responses.size() >= options_.max_pipelined_requests) {
+            return true;
+        }
+        const ssize_t result = recv(connection.fd, buffer, sizeof(buffer), 0);
+        if (result > 0) {
+            connection.input.append(buffer, static_cast<size_t>(result));
+        }
+        else if (result == 0) {
+            connection.read_closed = true;
+        }
+        else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            return true;
+        }
+        else if (errno != EINTR) {
+            return false;
+        }
+    }
+}
+
+bool NetworkServer::ParseRequests(uint64_t connection_id, Connection& connection, vector<Request>& requests) {
+    while (!connection.input.empty() && !connection.close_after_responses
+        && connection.responses.size() < options_.max_pipelined_requests) {
+        if (!connection.http) {
+            // binary requests are far shorter than 16 MB, so their first byte is zero
+            connection.http = connection.input[0] != 0;
+        }
+
+        if (*connection.http) {
+            const size_t head_end = connection.input.find("\r\n\r\n"sv);
+            if (head_end == string::npos) {
+                return connection.input.size() <= options_.max_request_size;
+            }
+            const string head = connection.input.substr(0, head_end);
+            connection.input.erase(0, head_end + 4);
+            HandleHttpRequest(connection_id, connection, head, requests);
+            continue;
+        }
+
+        const size_t frame_size = GetNetworkFrameSize(connection.input);
+        if (frame_size == 0) {
+            return true;
+        }
+        if (frame_size - FRAME_SIZE_BYTES > options_.max_request_size) {
+            return false;
+        }
+        if (connection.input.size() < frame_size) {
+            return true;
+        }
+        Request request;
+        request.connection_id = connection_id;
+        request.sequence = connection.first_sequence + connection.responses.size();
+        request.query = connection.input.substr(FRAME_SIZE_BYTES, frame_size - FRAME_SIZE_BYTES);
+        connection.input.erase(0, frame_size);
+        connection.responses.emplace_back();
+        requests.push_back(move(request));
+        ++request_count_;
+    }
+    return true;
+}
+
+void NetworkServer::HandleHttpRequest(uint64_t connection_id, Connection& connection, string_view head, vector<Request>& requests) {
+    ++request_count_;
+    ++http_request_count_;
+    const auto answer_now = [&connection](string response, bool close) {
+        connection.responses.emplace_back(move(response));
+        connection.close_after_responses = connection.close_after_responses || close;
+    };
+
+    const size_t line_end = min(head.find("\r\n"sv), head.size());
+    const string_view request_line = head.substr(0, line_end);
+    const size_t method_end = request_line.find(' ');
+    const size_t target_end = request_line.rfind(' ');
+    if (method_end == string_view::npos || target_end == method_end) {
+        answer_now(MakeHttpError(400, "Bad Request"sv, "Malformed request line"sv, true), true);
+        return;
+    }
+    const string_view method = request_line.substr(0, method_end);
+    const string_view target = request_line.substr(method_end + 1, target_end - method_end - 1);
+    bool close = request_line.substr(target_end + 1) != "HTTP/1.1"sv;
+
+    // bodies are not supported, their bytes would be taken for the next request
+    bool has_body = false;
+    for (string_view headers = head.substr(line_end); !headers.empty();) {
+        headers.remove_prefix(min<size_t>(2, headers.size()));
+        const size_t end = min(headers.find("\r\n"sv), headers.size());
+        const string_view line = headers.substr(0, end);
+        headers.remove_prefix(end);
+
+        const size_t colon = line.find(':');
+        if (colon == string_view::npos) {
+            continue;
+        }
+        const string name = ToLower(Trim(line.substr(0, colon)));
+        const string value = ToLower(Trim(line.substr(colon + 1)));
+        if (name == "connection"sv) {
+            close = value == "close"sv || (close && value != "keep-alive"sv);
+        }
+        else if ((name == "content-length"sv && value != "0"sv) || name == "transfer-encoding"sv) {
+            has_body = true;
+        }
+    }
+
+    if (has_body) {
+        answer_now(MakeHttpError(400, "Bad Request"sv, "Request bodies are not supported"sv, true), true);
+        return;
+    }
+    if (method != "GET"sv) {
+        answer_now(MakeHttpError(405, "Method Not Allowed"sv, "Only GET is supported"sv, close), close);
+        return;
+    }
+    const size_t question = min(target.find('?'), target.size());
+    if (target.substr(0, question) != "/search"sv) {
+        answer_now(MakeHttpError(404, "Not Found"sv, "Unknown path"sv, close), close);
+        return;
+    }
+
+    optional<string> query;
+    for (string_view parameters = target.substr(min(question + 1, target.size())); !parameters.empty();) {
+        const size_t end = min(parameters.find('&'), parameters.size());
+        const string_view parameter = parameters.substr(0, end);
+        parameters.remove_prefix(min(end + 1, parameters.size()));
+        if (parameter.substr(0, 6) == "query="sv) {
+            query = DecodeUrlComponent(parameter.substr(6));
+            if (!query) {
+                answer_now(MakeHttpError(400, "Bad Request"sv, "Malformed query parameter"sv, close), close);
+                return;
+            }
+        }
+    }
+    if (!query) {
+        answer_now(MakeHttpError(400, "Bad Request"sv, "Missing query parameter"sv, close), close);
+        return;
+    }
+
+    Request request;
+    request.connection_id = connection_id;
+    request.sequence = connection.first_sequence + connection.responses.size();
+    request.query = move(*query);
+    request.http = true;
+    request.close = close;
+    connection.responses.emplace_back();
+    connection.close_after_responses = close;
+    requests.push_back(move(request));
+}
+
+bool NetworkServer::Flush(Connection& connection) {
+    while (!connection.responses.empty() && connection.responses.front()) {
+        connection.output += *connection.responses.front();
+        connection.responses.pop_front();
+        ++connection.first_sequence;
+    }
+    while (connection.output_offset < connection.output.size()) {
+        const ssize_t result = send(connection.fd, connection.output.data() + connection.output_offset,
+            connection.output.size() - connection.output_offset, MSG_NOSIGNAL);
+        if (result < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return errno == EAGAIN || errno == EWOULDBLOCK;
+        }
+        connection.output_offset += static_cast<size_t>(result);
+    }
+    connection.output.clear();
+    connection.output_offset = 0;
+    return true;
+}
+
+void NetworkServer::TakeCompletions(vector<uint64_t>& touched) {
+    vector<Completion> completions;
+    {
+        lock_guard guard(completions_mutex_);
+        completions.swap(completions_);
+    }
+    for (Completion& completion : completions) {
+        // the connection may be gone already
+        const auto it = connections_.find(completion.connection_id);
+        if (it == connections_.end()) {
+            continue;
+        }
+        it->second.responses[completion.sequence - it->second.first_sequence] = move(completion.response);
+        touched.push_back(completion.connection_id);
+    }
+}
+
+void NetworkServer::Update(uint64_t connection_id, vector<Request>& requests) {
+    const auto it = connections_.find(connection_id);
+    if (it == connections_.end()) {
+        return;
+    }
+    Connection& connection = it->second;
+    if (!Flush(connection)) {
+        CloseConnection(connection_id);
+        return;
+    }
+    // requests buffered while the pipeline was full get no EPOLLIN of their own,
+    // answers given right away free their slots again
+    while (!connection.input.empty() && connection.responses.size() < options_.max_pipelined_requests) {
+        const size_t input_size = connection.input.size();
+        if (!ParseRequests(connection_id, connection, requests) || !Flush(connection)) {
+            CloseConnection(connection_id);
+            return;
+        }
+        if (connection.input.size() == input_size) {
+            break;
+        }
+    }
+
+    const bool output_pending = connection.output_offset < connection.output.size();
+    if (connection.responses.empty() && !output_pending && (connection.read_closed || connection.close_after_responses)) {
+        CloseConnection(connection_id);
+        return;
+    }
+
+    uint32_t events = output_pending ? static_cast<uint32_t>(EPOLLOUT) : 0u;
+    if (!connection.read_closed && !connection.close_after_responses
+        && connection.responses.size() < options_.max_pipelined_requests) {
+        events |= EPOLLIN;
+    }
+    if (events != connection.events) {
+        epoll_event event = {events, {.u64 = connection_id}};
+        epoll_ctl(epoll_fd_, EPOLL_CTL_MOD, connection.fd, &event);
+        connection.events = events;
+    }
+}
+
+void NetworkServer::CloseConnection(uint64_t connection_id) {
+    const auto it = connections_.find(connection_id);
+    // closing the descriptor also removes it from the epoll set
+    close(it->second.fd);
+    connections_.erase(it);
+}
+
+void NetworkServer::Dispatch(vector<Request>& requests) {
+    for (size_t begin = 0; begin < requests.size(); begin += options_.max_batch_size) {
+        const size_t end = min(begin + options_.max_batch_size, requests.size());
+        vector<Request> batch(make_move_iterator(requests.begin() + begin), make_move_iterator(requests.begin() + end));
+        {
+            lock_guard guard(batches_mutex_);
+            batches_.push_back(move(batch));
+        }
+        ++batch_count_;
+        has_batches_.notify_one();
+    }
+}
+
+void NetworkServer::WorkerLoop() {
+    for (;;) {
+        vector<Request> batch;
+        {
+            unique_lock lock(batches_mutex_);
+            has_batches_.wait(lock, [this] { return workers_stopping_ || !batches_.empty(); });
+            if (workers_stopping_) {
+                return;
+            }
+            batch = move(batches_.front());
+            batches_.pop_front();
+        }
+
+        vector<Completion> completions = ProcessBatch(batch);
+        {
+            lock_guard guard(completions_mutex_);
+            move(completions.begin(), completions.end(), back_inserter(completions_));
+        }
+        WakeUp(wake_fd_);
+    }
+}
+
+vector<NetworkServer::Completion> NetworkServer::ProcessBatch(const vector<Request>& batch) const {
+    vector<string_view> queries;
+    queries.reserve(batch.size());
+    for (const Request& request : batch) {
+        queries.push_back(request.query);
+    }
+
+    vector<vector<Document>> results;
+    vector<string> errors(batch.size());
+    try {
+        results = ProcessQueries(search_server_, queries);
+    } catch (const invalid_argument&) {
+        // one bad query must not fail the others, the batch is redone one query at a time
+        results.assign(batch.size(), {});
+        for (size_t i = 0; i < batch.size(); ++i) {
+            try {
+                results[i] = search_server_.FindTopDocuments(queries[i]);
+            } catch (const invalid_argument& error) {
+                errors[i] = error.what();
+            }
+        }
+    }
+
+    vector<Completion> completions;
+    completions.reserve(batch.size());
+    for (size_t i = 0; i < batch.size(); ++i) {
+        const vector<Document>* documents = errors[i].empty() ? &results[i] : nullptr;
+        completions.push_back({batch[i].connection_id, batch[i].sequence,
+            batch[i].http ? EncodeHttpResponse(documents, errors[i], batch[i].close) : EncodeBinaryResponse(documents, errors[i])});
+    }
+    return completions;
+}
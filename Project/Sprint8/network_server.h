@@ -0,0 +1,173 @@
+#pragma once
+
+#include "document.h"
+#include "search_server.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+// Binary protocol, integers in network byte order.
+// Request: size (uint32), query text.
+// Response: size (uint32), NetworkResponseStatus (uint8), then for OK the document count (uint32)
+// and id (int32), relevance (IEEE double as uint64), rating (int32) of each document,
+// for INVALID_QUERY the error message.
+// A connection whose first byte is not zero speaks HTTP/1.1 instead: GET /search?query=...
+// answers with {"documents":[{"id":..,"relevance":..,"rating":..}]}
+enum class NetworkResponseStatus : uint8_t {
+    OK = 0,
+    INVALID_QUERY = 1,
+};
+
+struct NetworkResponse {
+    NetworkResponseStatus status = NetworkResponseStatus::OK;
+    std::vector<Document> documents;
+    std::string error;
+};
+
+std::string EncodeNetworkRequest(std::string_view query);
+
+// Size of the whole frame at the start of data, 0 if the size isn't complete yet
+size_t GetNetworkFrameSize(std::string_view data);
+
+// Decodes one complete response frame. Throws std::runtime_error on a malformed response
+NetworkResponse DecodeNetworkResponse(std::string_view frame);
+
+struct NetworkServerOptions {
+    std::string address = "127.0.0.1";
+    // 0 picks a free port, see GetPort()
+    uint16_t port = 0;
+    // 0 means one per hardware thread
+    size_t worker_threads = 0;
+    // Requests read in one event loop iteration go to the workers in batches of at most this size
+    size_t max_batch_size = 64;
+    // A longer request closes the connection
+    size_t max_request_size = 64 << 10;
+    // A connection with this many unanswered requests isn't read until the answers are sent
+    size_t max_pipelined_requests = 256;
+};
+
+struct NetworkServerStats {
+    size_t connections = 0;
+    size_t requests = 0;
+    size_t http_requests = 0;
+    // ProcessQueries calls
+    size_t batches = 0;
+};
+
+// epoll front end for a SearchServer: one thread multiplexes all the connections and parses
+// pipelined requests, a pool of workers runs them through ProcessQueries, one call per batch.
+// Responses on a connection are sent in request order.
+// The server must not be modified while the front end runs
+class NetworkServer {
+public:
+    // Listens right away. Throws std::runtime_error if the address can't be bound
+    explicit NetworkServer(const SearchServer& search_server, NetworkServerOptions options = {});
+
+    NetworkServer(const NetworkServer&) = delete;
+    NetworkServer& operator=(const NetworkServer&) = delete;
+
+    ~NetworkServer();
+
+    uint16_t GetPort() const;
+
+    // Serves until Stop() is called, then closes every connection
+    void Run();
+
+    // May be called from any thread, also before Run()
+    void Stop();
+
+    NetworkServerStats GetStats() const;
+
+private:
+    struct Connection {
+        int fd = -1;
+        std::optional<bool> http;
+        std::string input;
+        std::string output;
+        size_t output_offset = 0;
+        // Answers in request order, empty until a worker produces them
+        std::deque<std::optional<std::string>> responses;
+        uint64_t first_sequence = 0;
+        bool read_closed = false;
+        bool close_after_responses = false;
+        uint32_t events = 0;
+    };
+
+    struct Request {
+        uint64_t connection_id = 0;
+        uint64_t sequence = 0;
+        std::string query;
+        bool http = false;
+        bool close = false;
+    };
+
+    struct Completion {
+        uint64_t connection_id = 0;
+        uint64_t sequence = 0;
+        std::string response;
+    };
+
+    void Accept();
+
+    // These return false if the connection has to be closed at once
+    bool Read(uint64_t connection_id, Connection& connection, std::vector<Request>& requests);
+
+    bool ParseRequests(uint64_t connection_id, Connection& connection, std::vector<Request>& requests);
+
+    // Moves the answers at the front to the output and sends what the socket takes
+    bool Flush(Connection& connection);
+
+    // head is the request line and the headers. Errors are answered right away
+    void HandleHttpRequest(uint64_t connection_id, Connection& connection, std::string_view head, std::vector<Request>& requests);
+
+    void TakeCompletions(std::vector<uint64_t>& touched);
+
+    void CloseConnection(uint64_t connection_id);
+
+    // Closes or re-arms the connection after its state changed, parsing the input
+    // that waited for the pipeline to drain into requests
+    void Update(uint64_t connection_id, std::vector<Request>& requests);
+
+    void Dispatch(std::vector<Request>& requests);
+
+    void WorkerLoop();
+
+    std::vector<Completion> ProcessBatch(const std::vector<Request>& batch) const;
+
+    const SearchServer& search_server_;
+    NetworkServerOptions options_;
+    int listen_fd_ = -1;
+    int epoll_fd_ = -1;
+    // Wakes up the event loop for completions and Stop()
+    int wake_fd_ = -1;
+    uint16_t port_ = 0;
+    std::atomic<bool> stopping_ = false;
+
+    // Owned by the event loop thread
+    std::map<uint64_t, Connection> connections_;
+    uint64_t next_connection_id_ = 1;
+
+    std::atomic<size_t> connection_count_ = 0;
+    std::atomic<size_t> request_count_ = 0;
+    std::atomic<size_t> http_request_count_ = 0;
+    std::atomic<size_t> batch_count_ = 0;
+
+    std::mutex batches_mutex_;
+    std::condition_variable has_batches_;
+    std::deque<std::vector<Request>> batches_;
+    bool workers_stopping_ = false;
+
+    std::mutex completions_mutex_;
+    std::vector<Completion> completions_;
+
+    std::vector<std::thread> workers_;
+};
@@ -0,0 +1,145 @@
+#include "numa_topology.h"
+
+#include <algorithm>
+#include <charconv>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+#include <thread>
+
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#if __has_include(<linux/mempolicy.h>)
+#include <linux/mempolicy.h>
+#else
+#define MPOL_PREFERRED 1
+#endif
+
+using namespace std;
+
+namespace {
+
+int ParseCpuNumber(string_view text) {
+    int value = 0;
+    const auto [end, error] = from_chars(text.data(), text.data() + text.size(), value);
+    if (text.empty() || error != errc() || end != text.data() + text.size() || value < 0) {
+        throw invalid_argument("Invalid CPU list item "s + string(text));
+    }
+    return value;
+}
+
+}  // namespace
+
+vector<int> ParseCpuList(string_view text) {
+    vector<int> cpus;
+    while (!text.empty() && (text.back() == '\n' || text.back() == ' ')) {
+        text.remove_suffix(1);
+    }
+    while (!text.empty()) {
+        const size_t comma = min(text.find(','), text.size());
+        const string_view item = text.substr(0, comma);
+        text.remove_prefix(min(comma + 1, text.size()));
+
+        const size_t dash = item.find('-');
+        if (dash == string_view::npos) {
+            cpus.push_back(ParseCpuNumber(item));
+            continue;
+        }
+        const int first = ParseCpuNumber(item.substr(0, dash));
+        const int last = ParseCpuNumber(item.substr(dash + 1));
+        if (first > last) {
+            throw invalid_argument("Invalid CPU range "s + string(item));
+        }
+        for (int cpu = first; cpu <= last; ++cpu) {
+            cpus.push_back(cpu);
+        }
+    }
+    return cpus;
+}
+
+NumaTopology::NumaTopology(vector<NumaNode> nodes)
+    : nodes_(move(nodes)) {
+    if (nodes_.empty()) {
+        throw invalid_argument("Topology must have at least one node"s);
+    }
+    for (size_t index = 0; index < nodes_.size(); ++index) {
+        for (const int cpu : nodes_[index].cpus) {
+            if (static_cast<size_t>(cpu) >= cpu_to_node_index_.size()) {
+                cpu_to_node_index_.resize(cpu + 1, -1);
+            }
+            cpu_to_node_index_[cpu] = static_cast<int>(index);
+        }
+    }
+}
+
+NumaTopology NumaTopology::Detect(const string& sysfs_path) {
+    vector<NumaNode> nodes;
+    error_code error;
+    for (const auto& entry : filesystem::directory_iterator(sysfs_path, error)) {
+        const string name = entry.path().filename().string();
+        if (name.size() <= 4 || name.compare(0, 4, "node"s) != 0
+            || !all_of(name.begin() + 4, name.end(), [](char c) { return c >= '0' && c <= '9'; })) {
+            continue;
+        }
+
+        ifstream cpulist(entry.path() / "cpulist"s);
+        string text;
+        getline(cpulist, text);
+        NumaNode node;
+        node.id = stoi(name.substr(4));
+        node.cpus = ParseCpuList(text);
+        // memory-only nodes can't run workers
+        if (!node.cpus.empty()) {
+            nodes.push_back(move(node));
+        }
+    }
+
+    if (nodes.empty()) {
+        NumaNode node;
+        for (int cpu = 0; cpu < static_cast<int>(max(thread::hardware_concurrency(), 1u)); ++cpu) {
+            node.cpus.push_back(cpu);
+        }
+        nodes.push_back(move(node));
+    }
+    sort(nodes.begin(), nodes.end(), [](const NumaNode& lhs, const NumaNode& rhs) { return lhs.id < rhs.id; });
+    return NumaTopology(move(nodes));
+}
+
+const vector<NumaNode>& NumaTopology::GetNodes() const {
+    return nodes_;
+}
+
+int NumaTopology::GetNodeIndexOfCpu(int cpu) const {
+    if (cpu < 0 || static_cast<size_t>(cpu) >= cpu_to_node_index_.size()) {
+        return -1;
+    }
+    return cpu_to_node_index_[cpu];
+}
+
+int NumaTopology::GetCurrentNodeIndex() const {
+    return GetNodeIndexOfCpu(sched_getcpu());
+}
+
+NodeBinding BindCurrentThreadToNode(const NumaNode& node) {
+    NodeBinding binding;
+
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    for (const int cpu : node.cpus) {
+        if (cpu < CPU_SETSIZE) {
+            CPU_SET(cpu, &cpus);
+        }
+    }
+    binding.pinned = sched_setaffinity(0, sizeof(cpus), &cpus) == 0;
+
+    // set_mempolicy through the raw system call, the project doesn't depend on libnuma
+    constexpr size_t MASK_BITS = 1024;
+    unsigned long mask[MASK_BITS / (8 * sizeof(unsigned long))] = {};
+    if (node.id >= 0 && static_cast<size_t>(node.id) < MASK_BITS) {
+        mask[node.id / (8 * sizeof(unsigned long))] |= 1ul << (node.id % (8 * sizeof(unsigned long)));
+        binding.memory_bound = syscall(SYS_set_mempolicy, MPOL_PREFERRED, mask, MASK_BITS) == 0;
+    }
+    return binding;
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+struct NumaNode {
+    // Kernel node number, node numbers may have gaps
+    int id = 0;
+    std::vector<int> cpus;
+};
+
+// NUMA nodes of the machine and the CPUs that belong to them
+class NumaTopology {
+public:
+    explicit NumaTopology(std::vector<NumaNode> nodes);
+
+    // Reads nodeN/cpulist files from sysfs. Without them the machine is one node with all the CPUs
+    static NumaTopology Detect(const std::string& sysfs_path = "/sys/devices/system/node");
+
+    const std::vector<NumaNode>& GetNodes() const;
+
+    // Index in GetNodes() of the node the CPU belongs to, -1 if the CPU is unknown
+    int GetNodeIndexOfCpu(int cpu) const;
+
+    // Node index of the CPU the calling thread runs on at the moment
+    int GetCurrentNodeIndex() const;
+
+private:
+    std::vector<NumaNode> nodes_;
+    std::vector<int> cpu_to_node_index_;
+};
+
+// Parses a kernel CPU list such as "0-3,8-11".
+// Throws std::invalid_argument on malformed input
+std::vector<int> ParseCpuList(std::string_view text);
+
+struct NodeBinding {
+    // The thread runs only on the node's CPUs
+    bool pinned = false;
+    // The thread's allocations prefer the node's memory
+    bool memory_bound = false;
+};
+
+// Binds the calling thread to the node. Each part may fail independently
+// (CPUs outside the cpuset, memory policies forbidden), the result tells which parts applied
+NodeBinding BindCurrentThreadToNode(const NumaNode& node);
@@ -1,32 +1,116 @@
 #include "process_queries.h"
 
 #include <algorithm>
-#include <execution>
+#include <condition_variable>
+#include <deque>
+#include <future>
+#include <map>
+#include <mutex>
+#include <thread>
 
 using namespace std;
 
+vector<vector<Document>> ProcessQueries(
+    const SearchServer& search_server,
+    span<const string_view> queries) {
+    return search_server.FindTopDocumentsBatch(queries);
+}
+
 vector<vector<Document>> ProcessQueries(
     const SearchServer& search_server,
     const vector<string>& queries) {
-    vector<vector<Document>> res(queries.size());
-    transform(execution::par, queries.begin(), queries.end(), res.begin(),
-        [&search_server](string query) { return search_server.FindTopDocuments(query); });
+    // views of the caller's strings, the queries aren't copied
+    const vector<string_view> views(queries.begin(), queries.end());
+    return ProcessQueries(search_server, span<const string_view>(views));
+}
 
-    return res;
+vector<TopDocumentsResult> ProcessQueries(
+    const SearchServer& search_server,
+    span<const string_view> queries,
+    const QueryLimits& limits) {
+    return search_server.FindTopDocumentsBatch(queries, DocumentStatus::ACTUAL, limits);
+}
+
+void ProcessQueriesJoined(
+    const SearchServer& search_server,
+    span<const string_view> queries,
+    const DocumentSink& sink,
+    JoinOptions options) {
+    const size_t batch_size = max<size_t>(options.batch_size, 1);
+    const size_t batch_count = (queries.size() + batch_size - 1) / batch_size;
+    const size_t max_in_flight = options.max_batches_in_flight != 0 ? options.max_batches_in_flight
+                                                                    : max(thread::hardware_concurrency(), 1u);
+
+    mutex completed_mutex;
+    condition_variable has_completed;
+    deque<size_t> completed;
+    // declared after what the batches use, so leaving on an exception waits for the running ones
+    vector<future<vector<vector<Document>>>> batches(batch_count);
+    // ranked batches that wait for an earlier one in QUERY_ORDER
+    map<size_t, vector<vector<Document>>> waiting;
+
+    const auto deliver = [&sink, batch_size](size_t batch, const vector<vector<Document>>& results) {
+        for (size_t i = 0; i < results.size(); ++i) {
+            for (const Document& document : results[i]) {
+                sink(batch * batch_size + i, document);
+            }
+        }
+    };
+
+    size_t launched = 0;
+    size_t delivered = 0;
+    while (delivered < batch_count) {
+        for (; launched < batch_count && launched - delivered < max_in_flight; ++launched) {
+            batches[launched] = async(launch::async, [&, batch = launched] {
+                const auto finish = [&completed_mutex, &has_completed, &completed, batch] {
+                    {
+                        lock_guard guard(completed_mutex);
+                        completed.push_back(batch);
+                    }
+                    has_completed.notify_one();
+                };
+                try {
+                    const size_t first = batch * batch_size;
+                    vector<vector<Document>> results = search_server.FindTopDocumentsBatch(
+                        queries.subspan(first, min(batch_size, queries.size() - first)));
+                    finish();
+                    return results;
+                } catch (...) {
+                    finish();
+                    throw;
+                }
+            });
+        }
+
+        size_t batch = 0;
+        {
+            unique_lock lock(completed_mutex);
+            has_completed.wait(lock, [&completed] { return !completed.empty(); });
+            batch = completed.front();
+            completed.pop_front();
+        }
+        vector<vector<Document>> results = batches[batch].get();
+        if (options.order == ResultOrder::AS_COMPLETED) {
+            deliver(batch, results);
+            ++delivered;
+            continue;
+        }
+        waiting.emplace(batch, move(results));
+        while (!waiting.empty() && waiting.begin()->first == delivered) {
+            deliver(delivered, waiting.begin()->second);
+            waiting.erase(waiting.begin());
+            ++delivered;
+        }
+    }
 }
 
 vector<Document> ProcessQueriesJoined(
     const SearchServer& search_server,
     const std::vector<std::string>& queries) {
-    auto temp = ProcessQueries(search_server, queries);
+    const vector<string_view> views(queries.begin(), queries.end());
     vector<Document> res;
-    size_t size = 0;
-    for (auto const& items: temp){
-        size += items.size();
-    }
-    res.reserve(size);
-    for (auto& items: temp){
-        move(items.begin(), items.end(), back_inserter(res));
-    }
+    ProcessQueriesJoined(search_server, span<const string_view>(views), [&res](size_t, const Document& document) {
+        res.push_back(document);
+    });
     return res;
 }
@@ -1,15 +1,57 @@
 #pragma once
 
 #include "document.h"
+#include "query_limits.h"
 #include "search_server.h"
 
+#include <functional>
+#include <span>
 #include <string>
+#include <string_view>
 #include <vector>
 
+// Runs the queries as one batch, see SearchServer::FindTopDocumentsBatch.
+// Throws std::invalid_argument for the first invalid query before any query is ranked
+std::vector<std::vector<Document>> ProcessQueries(
+    const SearchServer& search_server,
+    std::span<const std::string_view> queries);
+
 std::vector<std::vector<Document>> ProcessQueries(
     const SearchServer& search_server,
     const std::vector<std::string>& queries);
 
+// Stops ranking when the limits expire, see the FindTopDocumentsBatch overload taking QueryLimits
+std::vector<TopDocumentsResult> ProcessQueries(
+    const SearchServer& search_server,
+    std::span<const std::string_view> queries,
+    const QueryLimits& limits);
+
+enum class ResultOrder {
+    QUERY_ORDER,
+    AS_COMPLETED,
+};
+
+struct JoinOptions {
+    // Queries ranked together in one FindTopDocumentsBatch call
+    size_t batch_size = 64;
+    // Batches being ranked or waiting to be delivered, 0 means one per hardware thread.
+    // Memory for results is bounded by max_batches_in_flight * batch_size queries
+    size_t max_batches_in_flight = 0;
+    ResultOrder order = ResultOrder::QUERY_ORDER;
+};
+
+// Receives the documents of query number query_index, in the query's own order
+using DocumentSink = std::function<void(size_t query_index, const Document& document)>;
+
+// Streams the documents of every query to the sink as soon as its batch is ranked,
+// in query order or in the order the batches complete. The sink is called on the calling thread.
+// Throws std::invalid_argument for an invalid query, the batches before it may already be delivered
+void ProcessQueriesJoined(
+    const SearchServer& search_server,
+    std::span<const std::string_view> queries,
+    const DocumentSink& sink,
+    JoinOptions options = {});
+
 std::vector<Document> ProcessQueriesJoined(
     const SearchServer& search_server,
     const std::vector<std::string>& queries);
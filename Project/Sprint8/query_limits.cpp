@@ -0,0 +1,25 @@
+#include "query_limits.h"
+
+using namespace std;
+
+void CancellationToken::Cancel() {
+    cancelled_->store(true, memory_order_relaxed);
+}
+
+bool CancellationToken::IsCancelled() const {
+    return cancelled_->load(memory_order_relaxed);
+}
+
+QueryLimits QueryLimits::WithTimeout(chrono::steady_clock::duration timeout, ExpiryPolicy on_expiry) {
+    QueryLimits limits;
+    limits.deadline = chrono::steady_clock::now() + timeout;
+    limits.on_expiry = on_expiry;
+    return limits;
+}
+
+bool QueryLimits::IsExpired() const {
+    if (cancellation && cancellation->IsCancelled()) {
+        return true;
+    }
+    return deadline && chrono::steady_clock::now() >= *deadline;
+}
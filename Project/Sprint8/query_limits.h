@@ -0,0 +1,78 @@
+#pragma once
+
+#include "document.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <memory>
+#include <optional>
+#include <stdexcept>
+#include <vector>
+
+// Thrown instead of returning a truncated result, see QueryLimits::on_expiry
+class QueryInterruptedError : public std::runtime_error {
+public:
+    using std::runtime_error::runtime_error;
+};
+
+// Copies share the state: cancelling one cancels the queries checking any of them
+class CancellationToken {
+public:
+    void Cancel();
+
+    bool IsCancelled() const;
+
+private:
+    std::shared_ptr<std::atomic<bool>> cancelled_ = std::make_shared<std::atomic<bool>>(false);
+};
+
+enum class ExpiryPolicy {
+    // stop scoring and return the best documents found so far, marked as truncated
+    RETURN_PARTIAL,
+    // throw QueryInterruptedError
+    THROW,
+};
+
+struct QueryLimits {
+    std::optional<std::chrono::steady_clock::time_point> deadline;
+    std::optional<CancellationToken> cancellation;
+    ExpiryPolicy on_expiry = ExpiryPolicy::RETURN_PARTIAL;
+
+    static QueryLimits WithTimeout(std::chrono::steady_clock::duration timeout, ExpiryPolicy on_expiry = ExpiryPolicy::RETURN_PARTIAL);
+
+    // Deadline passed or cancelled
+    bool IsExpired() const;
+};
+
+struct TopDocumentsResult {
+    std::vector<Document> documents;
+    // Scoring stopped early, documents are the best among those scored before that
+    bool truncated = false;
+};
+
+// Checks the limits from a scoring loop: the clock is read once per CHECK_INTERVAL postings
+class QueryBudget {
+public:
+    static constexpr size_t CHECK_INTERVAL = 1024;
+
+    explicit QueryBudget(const QueryLimits& limits)
+        : limits_(limits) { }
+
+    // Call once per posting, true once the limits expired
+    bool Exhausted() {
+        if (!exhausted_ && ticks_++ % CHECK_INTERVAL == 0) {
+            exhausted_ = limits_.IsExpired();
+        }
+        return exhausted_;
+    }
+
+    bool IsExhausted() const {
+        return exhausted_;
+    }
+
+private:
+    const QueryLimits& limits_;
+    size_t ticks_ = 0;
+    bool exhausted_ = false;
+};
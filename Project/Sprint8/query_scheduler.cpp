@@ -0,0 +1,154 @@
+#include "process_queries.h"
+#include "query_scheduler.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+using namespace std;
+
+QueryScheduler::QueryScheduler(const SearchServer& search_server, QuerySchedulerOptions options)
+    : search_server_(search_server) {
+    if (options.classes.empty()) {
+        throw invalid_argument("Scheduler needs at least one priority class"s);
+    }
+    for (PriorityClassOptions& class_options : options.classes) {
+        if (!(class_options.weight > 0.0)) {
+            throw invalid_argument("Weight of priority class "s + class_options.name + " must be positive"s);
+        }
+        classes_.push_back({move(class_options), {}, 0.0, {}});
+    }
+    const size_t worker_count = options.worker_threads != 0 ? options.worker_threads
+                                                            : max(thread::hardware_concurrency(), 1u);
+    for (size_t i = 0; i < worker_count; ++i) {
+        workers_.emplace_back([this] { WorkerLoop(); });
+    }
+}
+
+QueryScheduler::~QueryScheduler() {
+    {
+        lock_guard guard(mutex_);
+        stopping_ = true;
+    }
+    has_work_.notify_all();
+    for (thread& worker : workers_) {
+        worker.join();
+    }
+}
+
+future<vector<Document>> QueryScheduler::FindTopDocuments(size_t priority_class, string_view raw_query, DocumentStatus status) {
+    return Submit(priority_class, [this, query = string(raw_query), status] {
+        return search_server_.FindTopDocuments(query, status);
+    });
+}
+
+future<vector<vector<Document>>> QueryScheduler::ProcessQueries(size_t priority_class, vector<string> queries) {
+    const double cost = static_cast<double>(max<size_t>(queries.size(), 1));
+    return Submit(priority_class, [this, queries = move(queries)] {
+        return ::ProcessQueries(search_server_, queries);
+    }, cost);
+}
+
+PriorityClassStats QueryScheduler::GetStats(size_t priority_class) const {
+    lock_guard guard(mutex_);
+    if (priority_class >= classes_.size()) {
+        throw invalid_argument("Unknown priority class "s + to_string(priority_class));
+    }
+    PriorityClassStats stats = classes_[priority_class].stats;
+    stats.queued = classes_[priority_class].queue.size();
+    return stats;
+}
+
+void QueryScheduler::Push(size_t priority_class, double cost, Job job) {
+    {
+        lock_guard guard(mutex_);
+        if (priority_class >= classes_.size()) {
+            throw invalid_argument("Unknown priority class "s + to_string(priority_class));
+        }
+        PriorityClass& target = classes_[priority_class];
+        if (target.queue.size() >= target.options.max_queued) {
+            ++target.stats.rejected;
+            throw OverloadError("Queue of priority class "s + target.options.name + " is full"s);
+        }
+        // a class that was idle starts at the current virtual time instead of spending saved-up credit
+        job.start_tag = max(virtual_time_, target.finish_tag);
+        target.finish_tag = job.start_tag + cost / target.options.weight;
+        job.enqueued_at = chrono::steady_clock::now();
+        target.queue.push_back(move(job));
+    }
+    has_work_.notify_one();
+}
+
+int QueryScheduler::PickClass(chrono::steady_clock::time_point now, vector<Job>& shed) {
+    int picked = -1;
+    for (size_t i = 0; i < classes_.size(); ++i) {
+        PriorityClass& candidate = classes_[i];
+        const auto max_wait = candidate.options.max_queue_wait;
+        while (max_wait.count() > 0 && !candidate.queue.empty() && now - candidate.queue.front().enqueued_at > max_wait) {
+            shed.push_back(move(candidate.queue.front()));
+            candidate.queue.pop_front();
+            ++candidate.stats.shed;
+        }
+        if (candidate.queue.empty()
+            || (candidate.options.max_concurrency != 0 && candidate.stats.running >= candidate.options.max_concurrency)) {
+            continue;
+        }
+        if (picked < 0 || candidate.queue.front().start_tag < classes_[picked].queue.front().start_tag) {
+            picked = static_cast<int>(i);
+        }
+    }
+    return picked;
+}
+
+void QueryScheduler::WorkerLoop() {
+    for (;;) {
+        Job job;
+        size_t priority_class = 0;
+        vector<Job> shed;
+        {
+            unique_lock lock(mutex_);
+            int picked = -1;
+            has_work_.wait(lock, [this, &picked, &shed] {
+                picked = PickClass(chrono::steady_clock::now(), shed);
+                const bool drained = all_of(classes_.begin(), classes_.end(), [](const PriorityClass& candidate) {
+                    return candidate.queue.empty();
+                });
+                // shed jobs are rejected outside the lock right away, not when a class frees up
+                return picked >= 0 || !shed.empty() || (stopping_ && drained);
+            });
+            if (picked >= 0) {
+                priority_class = static_cast<size_t>(picked);
+                PriorityClass& target = classes_[priority_class];
+                job = move(target.queue.front());
+                target.queue.pop_front();
+                virtual_time_ = job.start_tag;
+                ++target.stats.running;
+                const auto waited = chrono::steady_clock::now() - job.enqueued_at;
+                target.stats.total_queue_wait += waited;
+                target.stats.max_queue_wait = max(target.stats.max_queue_wait, waited);
+            }
+        }
+        for (Job& dropped : shed) {
+            dropped.reject(make_exception_ptr(OverloadError("Query shed after waiting too long in the queue"s)));
+        }
+        if (!job.run) {
+            if (shed.empty()) {
+                return;
+            }
+            continue;
+        }
+
+        const auto started_at = chrono::steady_clock::now();
+        job.run();
+        const auto executed = chrono::steady_clock::now() - started_at;
+        {
+            lock_guard guard(mutex_);
+            PriorityClassStats& stats = classes_[priority_class].stats;
+            --stats.running;
+            ++stats.completed;
+            stats.total_execution_time += executed;
+            stats.max_execution_time = max(stats.max_execution_time, executed);
+        }
+        // a freed concurrency slot may unblock a class another worker is waiting for
+        has_work_.notify_all();
+    }
+}
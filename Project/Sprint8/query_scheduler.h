@@ -0,0 +1,142 @@
+#pragma once
+
+#include "async_search_server.h"
+#include "document.h"
+#include "search_server.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+struct PriorityClassOptions {
+    std::string name;
+    // Share of the workers the class gets while other classes have queries waiting
+    double weight = 1.0;
+    // Queries of the class running at once, 0 means no limit besides the workers
+    size_t max_concurrency = 0;
+    // Further submissions throw OverloadError
+    size_t max_queued = 1024;
+    // A query found waiting longer when a worker looks for work is shed: its future gets OverloadError
+    // and it never runs. 0 disables shedding
+    std::chrono::milliseconds max_queue_wait{0};
+};
+
+struct QuerySchedulerOptions {
+    // 0 means one per hardware thread
+    size_t worker_threads = 0;
+    // Submissions name a class by its index here
+    std::vector<PriorityClassOptions> classes;
+};
+
+// Time from submission to the start of execution is reported apart from the execution itself
+struct PriorityClassStats {
+    size_t completed = 0;
+    size_t rejected = 0;
+    size_t shed = 0;
+    size_t queued = 0;
+    size_t running = 0;
+    std::chrono::steady_clock::duration total_queue_wait{};
+    std::chrono::steady_clock::duration max_queue_wait{};
+    std::chrono::steady_clock::duration total_execution_time{};
+    std::chrono::steady_clock::duration max_execution_time{};
+};
+
+// Admission control and weighted fair queuing in front of a SearchServer. Every priority class has
+// its own queue; workers take the next query by start-time fair queuing, so under contention each
+// class gets workers in proportion to its weight, within its concurrency limit.
+// A query costs 1, a batch of ProcessQueries costs the number of its queries.
+// The server must not be modified while queries run; the destructor finishes the queued ones
+class QueryScheduler {
+public:
+    // Throws std::invalid_argument without classes or with a non-positive weight
+    QueryScheduler(const SearchServer& search_server, QuerySchedulerOptions options);
+
+    QueryScheduler(const QueryScheduler&) = delete;
+    QueryScheduler& operator=(const QueryScheduler&) = delete;
+
+    ~QueryScheduler();
+
+    std::future<std::vector<Document>> FindTopDocuments(size_t priority_class, std::string_view raw_query,
+        DocumentStatus status = DocumentStatus::ACTUAL);
+
+    std::future<std::vector<std::vector<Document>>> ProcessQueries(size_t priority_class, std::vector<std::string> queries);
+
+    // Schedules any work on the server's workers. Throws OverloadError if the class queue is full
+    // and std::invalid_argument for an unknown class
+    template <typename Function>
+    std::future<std::invoke_result_t<Function>> Submit(size_t priority_class, Function function, double cost = 1.0);
+
+    PriorityClassStats GetStats(size_t priority_class) const;
+
+private:
+    struct Job {
+        std::function<void()> run;
+        std::function<void(std::exception_ptr)> reject;
+        double start_tag = 0.0;
+        std::chrono::steady_clock::time_point enqueued_at;
+    };
+
+    struct PriorityClass {
+        PriorityClassOptions options;
+        std::deque<Job> queue;
+        // Virtual finish time of the last queued job
+        double finish_tag = 0.0;
+        PriorityClassStats stats;
+    };
+
+    void Push(size_t priority_class, double cost, Job job);
+
+    // Index of the class to run next, -1 if every class is empty or at its limit.
+    // Moves shed jobs to shed
+    int PickClass(std::chrono::steady_clock::time_point now, std::vector<Job>& shed);
+
+    void WorkerLoop();
+
+    const SearchServer& search_server_;
+
+    mutable std::mutex mutex_;
+    std::condition_variable has_work_;
+    std::vector<PriorityClass> classes_;
+    // Start tag of the job dispatched last
+    double virtual_time_ = 0.0;
+    bool stopping_ = false;
+
+    std::vector<std::thread> workers_;
+};
+
+template <typename Function>
+std::future<std::invoke_result_t<Function>> QueryScheduler::Submit(size_t priority_class, Function function, double cost) {
+    using Result = std::invoke_result_t<Function>;
+    auto result = std::make_shared<std::promise<Result>>();
+    auto future = result->get_future();
+    Job job;
+    job.run = [result, function = std::move(function)]() mutable {
+        try {
+            if constexpr (std::is_void_v<Result>) {
+                function();
+                result->set_value();
+            }
+            else {
+                result->set_value(function());
+            }
+        } catch (...) {
+            result->set_exception(std::current_exception());
+        }
+    };
+    job.reject = [result](std::exception_ptr error) {
+        result->set_exception(error);
+    };
+    Push(priority_class, cost, std::move(job));
+    return future;
+}
@@ -0,0 +1,171 @@
+#include "read_replica.h"
+#include "snapshot.h"
+#include "write_ahead_log.h"
+
+#include <algorithm>
+#include <filesystem>
+#include <limits>
+#include <stdexcept>
+
+using namespace std;
+
+uint64_t ReplicationStatus::GetLagRecords() const {
+    return primary_sequence_number > applied_sequence_number ? primary_sequence_number - applied_sequence_number : 0;
+}
+
+ReadReplica::ReadReplica(const string& stop_words_text, string snapshot_path, string log_path,
+    ReadReplicaOptions options, SearchServerOptions server_options)
+    : stop_words_text_(stop_words_text)
+    , snapshot_path_(move(snapshot_path))
+    , log_path_(move(log_path))
+    , options_(options)
+    , server_options_(server_options) {
+    CatchUp();
+    follower_ = thread([this] { Follow(); });
+}
+
+ReadReplica::~ReadReplica() {
+    {
+        lock_guard guard(stop_mutex_);
+        stopping_ = true;
+    }
+    stop_requested_.notify_one();
+    follower_.join();
+}
+
+vector<Document> ReadReplica::FindTopDocuments(const string_view raw_query, DocumentStatus status) const {
+    CheckStaleness();
+    shared_lock lock(server_mutex_);
+    return server_->FindTopDocuments(raw_query, status);
+}
+
+int ReadReplica::GetDocumentCount() const {
+    shared_lock lock(server_mutex_);
+    return server_->GetDocumentCount();
+}
+
+ReplicationStatus ReadReplica::GetStatus() const {
+    ReplicationStatus status;
+    status.applied_sequence_number = applied_sequence_number_;
+    status.primary_sequence_number = primary_sequence_number_;
+    status.staleness = chrono::steady_clock::now() - chrono::steady_clock::time_point(chrono::steady_clock::duration(caught_up_at_));
+    status.bootstraps = bootstraps_;
+    return status;
+}
+
+void ReadReplica::CatchUp() {
+    lock_guard guard(catch_up_mutex_);
+    // the replica is as fresh as the log at the moment reading starts
+    const auto started_at = chrono::steady_clock::now();
+    if (!server_) {
+        Bootstrap();
+    }
+
+    uint64_t first_sequence_number = 0;
+    WriteAheadLog::ReadFrom(log_path_, 0, 1, [&first_sequence_number](const LogRecord& record) {
+        first_sequence_number = record.sequence_number;
+    });
+    if (first_sequence_number != log_first_sequence_number_) {
+        // a checkpoint truncated the log, new records start at the beginning again
+        log_first_sequence_number_ = first_sequence_number;
+        log_offset_ = 0;
+    }
+
+    // 0: read from the last position, 1: read the whole log, 2: the same after loading the snapshot
+    for (int attempt = 0; attempt < 3; ++attempt) {
+        vector<LogRecord> records;
+        bool gap = false;
+        uint64_t expected = applied_sequence_number_ + 1;
+        uint64_t last_seen = 0;
+        const size_t end = WriteAheadLog::ReadFrom(log_path_, log_offset_, numeric_limits<size_t>::max(),
+            [&records, &gap, &expected, &last_seen](const LogRecord& record) {
+                last_seen = max(last_seen, record.sequence_number);
+                if (gap || record.sequence_number < expected) {
+                    return;
+                }
+                if (record.sequence_number > expected) {
+                    gap = true;
+                    return;
+                }
+                records.push_back(record);
+                ++expected;
+            });
+        primary_sequence_number_ = max<uint64_t>(primary_sequence_number_, last_seen);
+
+        if (gap) {
+            if (attempt == 0 && log_offset_ != 0) {
+                log_offset_ = 0;
+            }
+            else if (attempt < 2) {
+                // the missing records are only in the snapshot now
+                Bootstrap();
+            }
+            continue;
+        }
+
+        if (!records.empty()) {
+            unique_lock lock(server_mutex_);
+            for (const LogRecord& record : records) {
+                if (record.operation == LogOperation::ADD_DOCUMENT) {
+                    // the primary rejected the same record
+                    try {
+                        server_->AddDocument(record.document_id, record.text, record.status, record.ratings);
+                    } catch (const invalid_argument&) {
+                    }
+                }
+                else {
+                    server_->RemoveDocument(record.document_id);
+                }
+                applied_sequence_number_ = record.sequence_number;
+            }
+        }
+        log_offset_ = end;
+        caught_up_at_ = started_at.time_since_epoch().count();
+        return;
+    }
+}
+
+void ReadReplica::Bootstrap() {
+    unique_ptr<SearchServer> server;
+    uint64_t sequence_number = 0;
+    // a checkpoint may replace the snapshot while it is read, the sequence number is checked on both sides
+    while (filesystem::exists(snapshot_path_)) {
+        sequence_number = ReadSnapshotInfo(snapshot_path_).log_sequence_number;
+        server = make_unique<SearchServer>(SearchServer::LoadSnapshot(snapshot_path_));
+        if (ReadSnapshotInfo(snapshot_path_).log_sequence_number == sequence_number) {
+            break;
+        }
+        server.reset();
+    }
+    if (!server) {
+        server = make_unique<SearchServer>(stop_words_text_, server_options_);
+    }
+
+    unique_lock lock(server_mutex_);
+    server_ = move(server);
+    applied_sequence_number_ = sequence_number;
+    primary_sequence_number_ = max<uint64_t>(primary_sequence_number_, sequence_number);
+    log_offset_ = 0;
+    ++bootstraps_;
+}
+
+void ReadReplica::Follow() {
+    unique_lock lock(stop_mutex_);
+    while (!stop_requested_.wait_for(lock, options_.poll_interval, [this] { return stopping_; })) {
+        lock.unlock();
+        try {
+            CatchUp();
+        } catch (const exception&) {
+            // an unreadable log or snapshot shows up as growing staleness
+        }
+        lock.lock();
+    }
+}
+
+void ReadReplica::CheckStaleness() const {
+    const auto staleness = GetStatus().staleness;
+    if (staleness > options_.max_staleness) {
+        throw runtime_error("Replica is "s + to_string(chrono::duration_cast<chrono::milliseconds>(staleness).count())
+            + " ms behind the primary"s);
+    }
+}
@@ -0,0 +1,94 @@
+#pragma once
+
+#include "document.h"
+#include "search_server.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+struct ReadReplicaOptions {
+    // How often the replica looks for new records in the primary's log
+    std::chrono::milliseconds poll_interval{10};
+    // Queries fail once the replica hasn't caught up with the log for this long
+    std::chrono::milliseconds max_staleness{1000};
+};
+
+struct ReplicationStatus {
+    uint64_t applied_sequence_number = 0;
+    // Last record of the primary the replica knows of
+    uint64_t primary_sequence_number = 0;
+    // Time since the replica last applied everything it found in the log
+    std::chrono::steady_clock::duration staleness{};
+    // Loads of the primary's snapshot, the first one included
+    size_t bootstraps = 0;
+
+    uint64_t GetLagRecords() const;
+};
+
+// Read-only copy of a DurableSearchServer in another process, kept up to date by shipping its log:
+// the replica loads the primary's snapshot, then tails its write-ahead log and applies new records.
+// When a checkpoint has truncated records the replica hasn't seen, it loads the new snapshot again.
+// Records become visible to replicas once written, possibly before the primary's fsync
+class ReadReplica {
+public:
+    // Bootstraps and catches up before returning, then follows the log in the background
+    ReadReplica(const std::string& stop_words_text, std::string snapshot_path, std::string log_path,
+        ReadReplicaOptions options = {}, SearchServerOptions server_options = {});
+
+    ReadReplica(const ReadReplica&) = delete;
+    ReadReplica& operator=(const ReadReplica&) = delete;
+
+    ~ReadReplica();
+
+    // Throws std::runtime_error if the replica is staler than max_staleness.
+    // May be called from several threads, concurrently with replication
+    std::vector<Document> FindTopDocuments(const std::string_view raw_query, DocumentStatus status = DocumentStatus::ACTUAL) const;
+
+    int GetDocumentCount() const;
+
+    ReplicationStatus GetStatus() const;
+
+    // Applies the records that are in the log now without waiting for the next poll
+    void CatchUp();
+
+private:
+    void Bootstrap();
+
+    void Follow();
+
+    void CheckStaleness() const;
+
+    std::string stop_words_text_;
+    std::string snapshot_path_;
+    std::string log_path_;
+    ReadReplicaOptions options_;
+    SearchServerOptions server_options_;
+
+    mutable std::shared_mutex server_mutex_;
+    std::unique_ptr<SearchServer> server_;
+
+    // Position in the log, changed only under catch_up_mutex_
+    std::mutex catch_up_mutex_;
+    size_t log_offset_ = 0;
+    // Sequence number of the first record in the log, it changes when a checkpoint truncates the log
+    uint64_t log_first_sequence_number_ = 0;
+
+    std::atomic<uint64_t> applied_sequence_number_ = 0;
+    std::atomic<uint64_t> primary_sequence_number_ = 0;
+    std::atomic<std::chrono::steady_clock::rep> caught_up_at_ = 0;
+    std::atomic<size_t> bootstraps_ = 0;
+
+    std::mutex stop_mutex_;
+    std::condition_variable stop_requested_;
+    bool stopping_ = false;
+    std::thread follower_;
+};
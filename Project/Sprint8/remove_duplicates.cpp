@@ -1,27 +1,192 @@
 #include "remove_duplicates.h"
 
+#include <limits>
+#include <numeric>
+#include <span>
+#include <stdexcept>
+#include <unordered_map>
+
 using namespace std;
 
 void RemoveDuplicates(SearchServer& search_server) {
+    const vector<int> document_ids(search_server.begin(), search_server.end());
+
+    // sharded signature table, keyed by the lower half of the signature
+    ConcurrentMap<uint64_t, vector<pair<DocumentSignature, int>>> signature_table(CONCURRENT_BUCKET_COUNT);
+    for_each(execution::par, document_ids.begin(), document_ids.end(),
+        [&search_server, &signature_table](int document_id) {
+            const DocumentSignature signature = search_server.GetDocumentSignature(document_id);
+            signature_table[signature.low].ref_to_value.emplace_back(signature, document_id);
+        });
+
     vector<int> ids_to_remove;
-    map<set<string_view>, int> existing_word_sets;
+    for (auto& [_, documents] : signature_table.BuildOrdinaryMap()) {
+        if (documents.size() < 2) {
+            continue;
+        }
 
-    for (auto document_id : search_server) {
-        auto words_freqs = search_server.GetWordFrequencies(document_id);
-        set<string_view> temp;
-        transform(words_freqs.begin(), words_freqs.end(), inserter(temp, temp.begin()),
-            [](const auto& elem) { return elem.first; });
+        // the document with the lowest id survives, words are compared only on hash collisions
+        sort(documents.begin(), documents.end(),
+            [](const auto& lhs, const auto& rhs) { return lhs.second < rhs.second; });
+        vector<pair<DocumentSignature, int>> originals;
+        for (const auto& [signature, document_id] : documents) {
+            const bool is_duplicate = any_of(originals.begin(), originals.end(),
+                [&search_server, signature = signature, document_id = document_id](const auto& original) {
+                    return original.first == signature && search_server.HaveSameWords(original.second, document_id);
+                });
 
-        if (existing_word_sets.count(temp)) {
-            ids_to_remove.push_back(document_id);
+            if (is_duplicate) {
+                ids_to_remove.push_back(document_id);
+            }
+            else {
+                originals.emplace_back(signature, document_id);
+            }
+        }
+    }
+
+    sort(ids_to_remove.begin(), ids_to_remove.end());
+    for (int id : ids_to_remove) {
+        cout << "Found duplicate document id " << id << endl;
+    }
+    search_server.RemoveDocuments(execution::par, ids_to_remove);
+}
+
+namespace {
+
+vector<uint64_t> ComputeMinHashSketch(span<const ForwardIndex::Entry> entries, const vector<uint64_t>& seeds) {
+    vector<uint64_t> sketch(seeds.size(), numeric_limits<uint64_t>::max());
+    for (const auto& entry : entries) {
+        for (size_t i = 0; i < seeds.size(); ++i) {
+            sketch[i] = min(sketch[i], HashWordId(entry.word_id, seeds[i]));
+        }
+    }
+    return sketch;
+}
+
+// Entries are sorted by word id
+double ComputeJaccard(span<const ForwardIndex::Entry> lhs, span<const ForwardIndex::Entry> rhs) {
+    size_t common = 0;
+    for (auto lhs_it = lhs.begin(), rhs_it = rhs.begin(); lhs_it != lhs.end() && rhs_it != rhs.end();) {
+        if (lhs_it->word_id < rhs_it->word_id) {
+            ++lhs_it;
+        }
+        else if (rhs_it->word_id < lhs_it->word_id) {
+            ++rhs_it;
         }
         else {
-            existing_word_sets.emplace(temp, document_id);
+            ++common;
+            ++lhs_it;
+            ++rhs_it;
+        }
+    }
+
+    const size_t united = lhs.size() + rhs.size() - common;
+    return united == 0 ? 1.0 : static_cast<double>(common) / united;
+}
+
+int FindRoot(vector<int>& parents, int index) {
+    while (parents[index] != index) {
+        parents[index] = parents[parents[index]];
+        index = parents[index];
+    }
+    return index;
+}
+
+}  // namespace
+
+vector<vector<int>> FindNearDuplicates(const SearchServer& search_server, NearDuplicateOptions options) {
+    // the parallel stages below can't pass GetWordFrequencies' exception on
+    if (!search_server.GetOptions().use_forward_index) {
+        throw logic_error("Near-duplicate detection requires the forward index"s);
+    }
+    if (options.band_count <= 0 || options.rows_per_band <= 0
+        || options.band_count > numeric_limits<int>::max() / options.rows_per_band) {
+        throw invalid_argument("Invalid LSH band parameters"s);
+    }
+
+    const vector<int> document_ids(search_server.begin(), search_server.end());
+    const int sketch_size = options.band_count * options.rows_per_band;
+
+    vector<uint64_t> seeds(sketch_size);
+    for (int i = 0; i < sketch_size; ++i) {
+        seeds[i] = HashWordId(i, 0x243f6a8885a308d3ull);
+    }
+
+    // MinHash sketches from the forward index
+    vector<span<const ForwardIndex::Entry>> entries(document_ids.size());
+    transform(document_ids.begin(), document_ids.end(), entries.begin(),
+        [&search_server](int document_id) { return search_server.GetWordFrequencies(document_id).entries(); });
+    vector<vector<uint64_t>> sketches(document_ids.size());
+    transform(execution::par, entries.begin(), entries.end(), sketches.begin(),
+        [&seeds](span<const ForwardIndex::Entry> document_entries) {
+            return ComputeMinHashSketch(document_entries, seeds);
+        });
+
+    // LSH banding, one task per band: documents sharing all rows of the band fall into one bucket.
+    // A document joins the first document kept in its bucket that passes the exact Jaccard check,
+    // otherwise it is kept itself, so a bucket of n near-copies costs n checks instead of n^2 pairs
+    vector<int> bands(options.band_count);
+    iota(bands.begin(), bands.end(), 0);
+    vector<vector<pair<int, int>>> band_links(bands.size());
+    transform(execution::par, bands.begin(), bands.end(), band_links.begin(),
+        [&options, &sketches, &entries](int band) {
+            unordered_map<uint64_t, vector<int>> buckets;
+            vector<pair<int, int>> links;
+            for (int index = 0; index < static_cast<int>(sketches.size()); ++index) {
+                uint64_t band_hash = HashWordId(band);
+                for (int row = 0; row < options.rows_per_band; ++row) {
+                    // MinHash values are already well mixed
+                    band_hash ^= sketches[index][band * options.rows_per_band + row] + 0x9e3779b97f4a7c15ull + (band_hash << 6) + (band_hash >> 2);
+                }
+
+                vector<int>& kept = buckets[band_hash];
+                const auto similar = find_if(kept.begin(), kept.end(), [&options, &entries, index](int kept_index) {
+                    return ComputeJaccard(entries[kept_index], entries[index]) >= options.jaccard_threshold;
+                });
+                if (similar == kept.end()) {
+                    kept.push_back(index);
+                }
+                else {
+                    links.emplace_back(*similar, index);
+                }
+            }
+            return links;
+        });
+
+    // similar documents are joined transitively
+    vector<int> parents(document_ids.size());
+    iota(parents.begin(), parents.end(), 0);
+    for (const auto& links : band_links) {
+        for (const auto& [lhs, rhs] : links) {
+            const int lhs_root = FindRoot(parents, lhs);
+            const int rhs_root = FindRoot(parents, rhs);
+            parents[max(lhs_root, rhs_root)] = min(lhs_root, rhs_root);
         }
     }
 
+    map<int, vector<int>> groups;
+    for (int index = 0; index < static_cast<int>(document_ids.size()); ++index) {
+        groups[FindRoot(parents, index)].push_back(document_ids[index]);
+    }
+
+    vector<vector<int>> result;
+    for (auto& [_, group] : groups) {
+        if (group.size() > 1) {
+            result.push_back(move(group));
+        }
+    }
+    return result;
+}
+
+void RemoveNearDuplicates(SearchServer& search_server, NearDuplicateOptions options) {
+    vector<int> ids_to_remove;
+    for (const auto& group : FindNearDuplicates(search_server, options)) {
+        ids_to_remove.insert(ids_to_remove.end(), next(group.begin()), group.end());
+    }
+
+    sort(ids_to_remove.begin(), ids_to_remove.end());
     for (int id : ids_to_remove) {
-        cout << "Found duplicate document id " << id << endl;
-        search_server.RemoveDocument(id);
+        cout << "Found near-duplicate document id " << id << endl;
     }
+    search_server.RemoveDocuments(execution::par, ids_to_remove);
 }
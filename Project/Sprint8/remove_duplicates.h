@@ -2,4 +2,22 @@
 
 #include "search_server.h"
 
+#include <vector>
+
+struct NearDuplicateOptions {
+    // Documents whose word sets have at least this Jaccard similarity are near-duplicates
+    double jaccard_threshold = 0.8;
+    // MinHash sketch holds band_count * rows_per_band values
+    int band_count = 16;
+    int rows_per_band = 4;
+};
+
 void RemoveDuplicates(SearchServer& search_server);
+
+// Groups of near-duplicate documents, every group is sorted by id.
+// Throws std::logic_error if the forward index is disabled
+// and std::invalid_argument if band_count or rows_per_band isn't positive
+std::vector<std::vector<int>> FindNearDuplicates(const SearchServer& search_server, NearDuplicateOptions options = {});
+
+// Keeps the document with the lowest id of every group
+void RemoveNearDuplicates(SearchServer& search_server, NearDuplicateOptions options = {});
@@ -0,0 +1,234 @@
+#include "search_coordinator.h"
+#include "shard_server.h"
+#include "sharded_search_server.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <numeric>
+#include <stdexcept>
+
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+using namespace std;
+
+namespace {
+
+ShardMessageType GetResponseType(ShardMessageType request_type) {
+    return request_type == ShardMessageType::STATISTICS_REQUEST ? ShardMessageType::STATISTICS_RESPONSE
+                                                                : ShardMessageType::SEARCH_RESPONSE;
+}
+
+}  // namespace
+
+bool CoordinatedSearchResult::IsPartial() const {
+    return !failures.empty();
+}
+
+SearchCoordinator::SearchCoordinator(vector<string> socket_paths, SearchCoordinatorOptions options)
+    : options_(options) {
+    if (socket_paths.empty()) {
+        throw invalid_argument("Coordinator needs at least one shard"s);
+    }
+    for (string& socket_path : socket_paths) {
+        // checked here so a bad path is a configuration error, not a failure of every query
+        MakeUnixSocketAddress(socket_path);
+        shards_.push_back({move(socket_path), -1});
+    }
+}
+
+SearchCoordinator::~SearchCoordinator() {
+    for (Shard& shard : shards_) {
+        Disconnect(shard);
+    }
+}
+
+size_t SearchCoordinator::GetShardCount() const {
+    return shards_.size();
+}
+
+CoordinatedSearchResult SearchCoordinator::FindTopDocuments(const string_view raw_query, DocumentStatus status) {
+    lock_guard guard(mutex_);
+    CoordinatedSearchResult result;
+
+    ShardMessage request;
+    request.type = ShardMessageType::STATISTICS_REQUEST;
+    request.query = raw_query;
+    vector<size_t> shard_indexes(shards_.size());
+    iota(shard_indexes.begin(), shard_indexes.end(), 0);
+
+    // both phases drop the shards that didn't answer the way the request expects
+    const auto collect_answers = [this, &result, &request, &shard_indexes](const auto& on_answer) {
+        const vector<optional<ShardMessage>> responses = Exchange(shard_indexes, request, result.failures);
+        vector<size_t> answered;
+        for (size_t i = 0; i < responses.size(); ++i) {
+            if (!responses[i]) {
+                continue;
+            }
+            if (responses[i]->type == ShardMessageType::INVALID_QUERY_RESPONSE) {
+                throw invalid_argument(responses[i]->error);
+            }
+            if (responses[i]->type != GetResponseType(request.type)) {
+                result.failures.push_back({shard_indexes[i], "Unexpected response type"s});
+                Disconnect(shards_[shard_indexes[i]]);
+                continue;
+            }
+            on_answer(*responses[i]);
+            answered.push_back(shard_indexes[i]);
+        }
+        shard_indexes = move(answered);
+    };
+
+    collect_answers([&request](const ShardMessage& response) {
+        request.statistics.document_count += response.statistics.document_count;
+        for (const auto& [word, document_freq] : response.statistics.document_freqs) {
+            request.statistics.document_freqs[word] += document_freq;
+        }
+    });
+    result.statistics_shards = shard_indexes.size();
+
+    request.type = ShardMessageType::SEARCH_REQUEST;
+    request.status = status;
+    vector<vector<Document>> shard_results;
+    collect_answers([&shard_results](const ShardMessage& response) {
+        shard_results.push_back(response.documents);
+    });
+
+    result.answered_shards = shard_results.size();
+    result.documents = ShardedSearchServer::MergeTopDocuments(shard_results);
+    sort(result.failures.begin(), result.failures.end(), [](const ShardFailure& lhs, const ShardFailure& rhs) {
+        return lhs.shard < rhs.shard;
+    });
+    return result;
+}
+
+vector<optional<ShardMessage>> SearchCoordinator::Exchange(const vector<size_t>& shard_indexes, const ShardMessage& request,
+    vector<ShardFailure>& failures) {
+    struct Pending {
+        size_t position = 0;
+        size_t written = 0;
+        string received;
+    };
+
+    const auto deadline = chrono::steady_clock::now() + options_.shard_timeout;
+    string frame;
+    EncodeShardMessage(request, frame);
+
+    vector<optional<ShardMessage>> responses(shard_indexes.size());
+    vector<Pending> pending;
+    for (size_t position = 0; position < shard_indexes.size(); ++position) {
+        string error;
+        if (Connect(shards_[shard_indexes[position]], error)) {
+            pending.push_back({position, 0, {}});
+        }
+        else {
+            failures.push_back({shard_indexes[position], move(error)});
+        }
+    }
+
+    const auto fail = [this, &failures, &shard_indexes](const Pending& shard, string reason) {
+        failures.push_back({shard_indexes[shard.position], move(reason)});
+        Disconnect(shards_[shard_indexes[shard.position]]);
+    };
+
+    vector<pollfd> fds;
+    while (!pending.empty()) {
+        const auto remaining = chrono::ceil<chrono::milliseconds>(deadline - chrono::steady_clock::now());
+        if (remaining.count() <= 0) {
+            break;
+        }
+        fds.clear();
+        for (const Pending& shard : pending) {
+            const short events = shard.written < frame.size() ? POLLOUT : POLLIN;
+            fds.push_back({shards_[shard_indexes[shard.position]].fd, events, 0});
+        }
+        if (poll(fds.data(), fds.size(), static_cast<int>(remaining.count())) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw runtime_error("Can't wait for shards: "s + strerror(errno));
+        }
+
+        vector<Pending> still_pending;
+        for (size_t i = 0; i < pending.size(); ++i) {
+            Pending& shard = pending[i];
+            const int fd = fds[i].fd;
+            if (fds[i].revents == 0) {
+                still_pending.push_back(move(shard));
+                continue;
+            }
+
+            if (shard.written < frame.size()) {
+                const ssize_t result = send(fd, frame.data() + shard.written, frame.size() - shard.written, MSG_NOSIGNAL | MSG_DONTWAIT);
+                if (result < 0 && errno != EAGAIN && errno != EINTR) {
+                    fail(shard, "Can't send request: "s + strerror(errno));
+                    continue;
+                }
+                shard.written += static_cast<size_t>(max<ssize_t>(result, 0));
+                still_pending.push_back(move(shard));
+                continue;
+            }
+
+            char buffer[1 << 16];
+            const ssize_t result = recv(fd, buffer, sizeof(buffer), MSG_DONTWAIT);
+            if (result == 0) {
+                fail(shard, "Connection closed"s);
+                continue;
+            }
+            if (result < 0) {
+                if (errno == EAGAIN || errno == EINTR) {
+                    still_pending.push_back(move(shard));
+                }
+                else {
+                    fail(shard, "Can't receive response: "s + strerror(errno));
+                }
+                continue;
+            }
+            shard.received.append(buffer, static_cast<size_t>(result));
+
+            try {
+                const size_t frame_size = GetShardFrameSize(shard.received);
+                if (frame_size == 0 || shard.received.size() < frame_size) {
+                    still_pending.push_back(move(shard));
+                    continue;
+                }
+                if (shard.received.size() > frame_size) {
+                    throw runtime_error("Unrequested data after the response"s);
+                }
+                responses[shard.position] = DecodeShardMessage(shard.received);
+            } catch (const runtime_error& error) {
+                fail(shard, error.what());
+            }
+        }
+        pending = move(still_pending);
+    }
+
+    for (const Pending& shard : pending) {
+        fail(shard, "Timed out"s);
+    }
+    return responses;
+}
+
+bool SearchCoordinator::Connect(Shard& shard, string& error) {
+    if (shard.fd >= 0) {
+        return true;
+    }
+    const sockaddr_un address = MakeUnixSocketAddress(shard.socket_path);
+    // non-blocking, so a shard with a full backlog fails instead of stalling the query
+    shard.fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (shard.fd < 0 || connect(shard.fd, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0) {
+        error = "Can't connect to "s + shard.socket_path + ": "s + strerror(errno);
+        Disconnect(shard);
+        return false;
+    }
+    return true;
+}
+
+void SearchCoordinator::Disconnect(Shard& shard) {
+    if (shard.fd >= 0) {
+        close(shard.fd);
+        shard.fd = -1;
+    }
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include "document.h"
+#include "shard_protocol.h"
+
+#include <chrono>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+struct SearchCoordinatorOptions {
+    // Time a shard has to answer one phase of a query, connecting included
+    std::chrono::milliseconds shard_timeout{1000};
+};
+
+struct ShardFailure {
+    size_t shard = 0;
+    std::string reason;
+};
+
+struct CoordinatedSearchResult {
+    std::vector<Document> documents;
+    // Shards that contributed to documents
+    size_t answered_shards = 0;
+    // Shards whose document counts went into the IDF statistics. A shard that fails the search phase
+    // still counts here, so it can exceed answered_shards
+    size_t statistics_shards = 0;
+    std::vector<ShardFailure> failures;
+
+    // Some shards didn't answer, documents cover only a part of the corpus
+    bool IsPartial() const;
+};
+
+// Scatter-gather over shard processes (see ShardServer) listening on Unix domain sockets.
+// A query takes two round trips: the shards first report document counts for the query words,
+// then rank with the summed statistics, so relevance matches a single server holding every answering shard.
+// A shard that times out or breaks the connection is reported in failures and reconnected on the next query.
+// Calls are serialized, the connections are shared by all of them
+class SearchCoordinator {
+public:
+    explicit SearchCoordinator(std::vector<std::string> socket_paths, SearchCoordinatorOptions options = {});
+
+    SearchCoordinator(const SearchCoordinator&) = delete;
+    SearchCoordinator& operator=(const SearchCoordinator&) = delete;
+
+    ~SearchCoordinator();
+
+    size_t GetShardCount() const;
+
+    // Throws std::invalid_argument if a shard rejects the query
+    CoordinatedSearchResult FindTopDocuments(const std::string_view raw_query, DocumentStatus status = DocumentStatus::ACTUAL);
+
+private:
+    struct Shard {
+        std::string socket_path;
+        int fd = -1;
+    };
+
+    // Sends the request to the listed shards and waits for their responses until the deadline.
+    // Shards without a response get a failure and lose their connection: a late answer would be
+    // taken for the answer to the next request
+    std::vector<std::optional<ShardMessage>> Exchange(const std::vector<size_t>& shard_indexes, const ShardMessage& request,
+        std::vector<ShardFailure>& failures);
+
+    bool Connect(Shard& shard, std::string& error);
+
+    void Disconnect(Shard& shard);
+
+    SearchCoordinatorOptions options_;
+    std::mutex mutex_;
+    std::vector<Shard> shards_;
+};
@@ -1,21 +1,84 @@
 #include "search_server.h"
 
+#include <numeric>
+#include <thread>
+#include <unordered_map>
+
 using namespace std;
 
+namespace {
+
+// Keeps top ordered by SearchServer::IsMoreRelevant and at most MAX_RESULT_DOCUMENT_COUNT long
+void InsertTopDocument(vector<Document>& top, const Document& document) {
+    if (top.size() == MAX_RESULT_DOCUMENT_COUNT && !SearchServer::IsMoreRelevant(document, top.back())) {
+        return;
+    }
+    const auto position = find_if(top.begin(), top.end(), [&document](const Document& other) {
+        return SearchServer::IsMoreRelevant(document, other);
+    });
+    top.insert(position, document);
+    if (top.size() > MAX_RESULT_DOCUMENT_COUNT) {
+        top.pop_back();
+    }
+}
+
+}  // namespace
+
 int SearchServer::GetDocumentCount() const {
     return documents_.size();
 }
 
-const std::map<std::string_view, double>& SearchServer::GetWordFrequencies(int document_id) const {
-    static const map<string_view, double> no_documents_;
+const SearchServerOptions& SearchServer::GetOptions() const {
+    return options_;
+}
 
-    if (document_to_word_freqs_.count(document_id)) {
-        auto it = document_to_word_freqs_.find(document_id);
-        return it->second;
+WordFrequenciesView SearchServer::GetWordFrequencies(int document_id) const {
+    if (!options_.use_forward_index) {
+        throw logic_error("Forward index is disabled"s);
     }
-    else {
-        return no_documents_;
+    return {document_to_word_freqs_.Get(document_id), id_to_word_};
+}
+
+IndexMemoryUsage SearchServer::GetMemoryUsage() const {
+    IndexMemoryUsage usage;
+
+    for (const auto& [word, document_freqs] : word_to_document_freqs_) {
+        usage.postings += TREE_NODE_OVERHEAD + sizeof(pair<const string_view, map<int, double>>)
+            + document_freqs.size() * POSTING_ENTRY_BYTES;
+    }
+    usage.dictionary += words_.size() * (TREE_NODE_OVERHEAD + sizeof(pair<const string_view, uint32_t>));
+    for (const string& word : word_storage_) {
+        usage.dictionary += sizeof(string) + (word.capacity() > SSO_CAPACITY ? word.capacity() + 1 : 0);
     }
+    usage.dictionary += id_to_word_.capacity() * sizeof(string_view) + free_word_ids_.capacity() * sizeof(uint32_t);
+    usage.forward_index = document_to_word_freqs_.GetMemoryUsage();
+    usage.documents = documents_.size() * DOCUMENT_ENTRY_BYTES;
+    return usage;
+}
+
+DocumentSignature SearchServer::GetDocumentSignature(int document_id) const {
+    return documents_.at(document_id).signature;
+}
+
+bool SearchServer::HaveSameWords(int lhs_document_id, int rhs_document_id) const {
+    if (!options_.use_forward_index) {
+        vector<string_view> lhs_words = FindDocumentWords(lhs_document_id);
+        vector<string_view> rhs_words = FindDocumentWords(rhs_document_id);
+        return lhs_words == rhs_words;
+    }
+
+    // entries are sorted by word id
+    const auto lhs_entries = document_to_word_freqs_.Get(lhs_document_id);
+    const auto rhs_entries = document_to_word_freqs_.Get(rhs_document_id);
+    return equal(lhs_entries.begin(), lhs_entries.end(), rhs_entries.begin(), rhs_entries.end(),
+        [](const ForwardIndex::Entry& lhs, const ForwardIndex::Entry& rhs) { return lhs.word_id == rhs.word_id; });
+}
+
+optional<int> SearchServer::FindAliasOriginal(int alias_id) const {
+    if (auto it = alias_to_document_.find(alias_id); it != alias_to_document_.end()) {
+        return it->second;
+    }
+    return nullopt;
 }
 
 std::set<int>::const_iterator SearchServer::begin() const {
@@ -27,43 +90,151 @@ std::set<int>::const_iterator SearchServer::end() const {
 }
 
 void SearchServer::AddDocument(int document_id, const string_view document, DocumentStatus status, const vector<int>& ratings) {
-    if ((document_id < 0) || (documents_.count(document_id) > 0)) {
-        throw invalid_argument("Document id is less than zero or is used"s);
-    }
+    AddDocument(PrepareDocument(document_id, document, status, ratings));
+}
+
+void SearchServer::AddDocument(int document_id, StableText document, DocumentStatus status, const vector<int>& ratings) {
+    AddDocument(PrepareDocument(document_id, document, status, ratings));
+}
+
+StableText SearchServer::MapCorpus(const string& path) {
+    return MapCorpus(MappedFile(path));
+}
+
+StableText SearchServer::MapCorpus(MappedFile file) {
+    corpora_.push_back(make_shared<const MappedFile>(move(file)));
+    return StableText(corpora_.back()->View());
+}
+
+PreparedDocument SearchServer::PrepareDocument(int document_id, const string_view document, DocumentStatus status,
+    const vector<int>& ratings) const {
+    PreparedDocument prepared;
+    prepared.document_id = document_id;
+    prepared.status = status;
+    prepared.rating = ComputeAverageRating(ratings);
 
-    const vector<string_view> words = SplitIntoWordsNoStop(document);
+    vector<string_view> words = SplitIntoWordsNoStop(document);
     const double inv_word_count = 1.0 / words.size();
+    sort(words.begin(), words.end());
+    for (auto it = words.begin(); it != words.end();) {
+        const auto next_it = upper_bound(it, words.end(), *it);
+        prepared.word_freqs.emplace_back(*it, (next_it - it) * inv_word_count);
+        it = next_it;
+    }
+    return prepared;
+}
 
-    for (const string_view word : words) {
-        words_.emplace(word);
-        auto it = words_.find(word);
-        word_to_document_freqs_[*it][document_id] += inv_word_count;
-        document_to_word_freqs_[document_id][*it] += inv_word_count;
+PreparedDocument SearchServer::PrepareDocument(int document_id, StableText document, DocumentStatus status,
+    const vector<int>& ratings) const {
+    PreparedDocument prepared = PrepareDocument(document_id, document.View(), status, ratings);
+    prepared.borrow_words = true;
+    return prepared;
+}
+
+void SearchServer::AddDocument(PreparedDocument document) {
+    // deduplication compares the document with the committed ones, so writers take turns
+    unique_lock deduplication_lock(writer_locks_.deduplication, defer_lock);
+    if (options_.duplicate_policy != DuplicatePolicy::ALLOW) {
+        deduplication_lock.lock();
     }
 
-    document_ids_.insert(document_id);
-    documents_.emplace(document_id,
-        SearchServer::DocumentData {
-        SearchServer::ComputeAverageRating(ratings),
-        status
-    });
+    const int document_id = document.document_id;
+    {
+        lock_guard guard(writer_locks_.documents);
+        if ((document_id < 0) || (documents_.count(document_id) > 0) || (alias_to_document_.count(document_id) > 0)) {
+            throw invalid_argument("Document id is less than zero or is used"s);
+        }
+
+        if (options_.duplicate_policy != DuplicatePolicy::ALLOW) {
+            if (const auto original_id = FindDuplicate(document.word_freqs)) {
+                if (options_.duplicate_policy == DuplicatePolicy::REJECT) {
+                    throw invalid_argument("Document is a duplicate of document "s + to_string(*original_id));
+                }
+                alias_to_document_.emplace(document_id, *original_id);
+                document_to_aliases_[*original_id].push_back(document_id);
+                return;
+            }
+        }
+
+        // the id is reserved here, the signature is filled in when the words are indexed
+        document_ids_.insert(document_id);
+        documents_.emplace(document_id, SearchServer::DocumentData{document.rating, document.status, {}});
+    }
+
+    // known words are resolved under the shared lock, new ones are added under the exclusive lock
+    vector<ForwardIndex::Entry> entries(document.word_freqs.size());
+    vector<map<int, double>*> postings(document.word_freqs.size());
+    vector<size_t> new_words;
+    {
+        shared_lock lock(writer_locks_.dictionary);
+        for (size_t i = 0; i < document.word_freqs.size(); ++i) {
+            const auto [word, term_freq] = document.word_freqs[i];
+            if (auto it = words_.find(word); it != words_.end()) {
+                entries[i] = {it->second, static_cast<float>(term_freq)};
+                postings[i] = &word_to_document_freqs_.find(it->first)->second;
+            }
+            else {
+                new_words.push_back(i);
+            }
+        }
+    }
+    if (!new_words.empty()) {
+        lock_guard lock(writer_locks_.dictionary);
+        for (const size_t i : new_words) {
+            const auto [word, term_freq] = document.word_freqs[i];
+            const uint32_t word_id = AcquireWordId(word, document.borrow_words);
+            entries[i] = {word_id, static_cast<float>(term_freq)};
+            postings[i] = &word_to_document_freqs_[id_to_word_[word_id]];
+        }
+    }
+
+    // posting lists are std::map nodes, they don't move while other words are inserted
+    for (size_t i = 0; i < entries.size(); ++i) {
+        lock_guard lock(writer_locks_.postings[entries[i].word_id % POSTING_LOCK_COUNT]);
+        (*postings[i])[document_id] = document.word_freqs[i].second;
+    }
+
+    sort(entries.begin(), entries.end(),
+        [](const ForwardIndex::Entry& lhs, const ForwardIndex::Entry& rhs) { return lhs.word_id < rhs.word_id; });
+    vector<uint32_t> word_ids;
+    word_ids.reserve(entries.size());
+    for (const ForwardIndex::Entry& entry : entries) {
+        word_ids.push_back(entry.word_id);
+    }
+    const DocumentSignature signature = ComputeSignature(word_ids);
+    if (options_.use_forward_index) {
+        lock_guard lock(writer_locks_.forward_index);
+        document_to_word_freqs_.Add(document_id, move(entries));
+    }
+
+    lock_guard guard(writer_locks_.documents);
+    documents_.at(document_id).signature = signature;
+    if (options_.duplicate_policy != DuplicatePolicy::ALLOW) {
+        signature_to_documents_[signature].push_back(document_id);
+    }
 }
 
 void SearchServer::RemoveDocument(int document_id) {
-    //remove from word_to_document_freqs_
-    auto it = document_to_word_freqs_.find(document_id);
-    for (auto& [word, freq] : it->second) {
-        word_to_document_freqs_[word].erase(document_id);
+    if (RemoveAlias(document_id) || documents_.count(document_id) == 0) {
+        return;
     }
 
-    //remove from document_to_word_freqs_
-    document_to_word_freqs_.erase(document_id);
+    //remove from word_to_document_freqs_
+    const vector<string_view> words = FindDocumentWords(document_id);
+    vector<string_view> dead_words;
+    for (const string_view word : words) {
+        auto& document_freqs = word_to_document_freqs_.at(word);
+        document_freqs.erase(document_id);
+        if (document_freqs.empty()) {
+            dead_words.push_back(word);
+        }
+    }
 
-    //remove from documents_
-    documents_.erase(document_id);
+    //remove from document_to_word_freqs_, documents_ and document_ids_
+    EraseDocumentsData({document_id}, words.size());
 
-    //remove from document_ids_
-    document_ids_.erase(document_id);
+    //remove words no document refers to anymore
+    ReleaseWords(dead_words);
 }
 
 void SearchServer::RemoveDocument(const execution::sequenced_policy& policy, int document_id) {
@@ -71,20 +242,98 @@ void SearchServer::RemoveDocument(const execution::sequenced_policy& policy, int
 }
 
 void SearchServer::RemoveDocument(const execution::parallel_policy& policy, int document_id) {
+    if (RemoveAlias(document_id) || documents_.count(document_id) == 0) {
+        return;
+    }
+
     //remove from word_to_document_freqs_
-    auto it = document_to_word_freqs_.find(document_id);
-    std::map<std::string_view, double> cur_word_freqs = it->second;
-    for_each(policy, cur_word_freqs.begin(), cur_word_freqs.end(),
-        [this, document_id](auto& word_freq) { word_to_document_freqs_[word_freq.first].erase(document_id); });
+    const vector<string_view> words = FindDocumentWords(document_id);
+    vector<map<int, double>*> postings;
+    postings.reserve(words.size());
+    for (const string_view word : words) {
+        postings.push_back(&word_to_document_freqs_.at(word));
+    }
+    for_each(policy, postings.begin(), postings.end(),
+        [document_id](map<int, double>* document_freqs) { document_freqs->erase(document_id); });
+
+    vector<string_view> dead_words;
+    for (size_t i = 0; const string_view word : words) {
+        if (postings[i++]->empty()) {
+            dead_words.push_back(word);
+        }
+    }
+
+    //remove from document_to_word_freqs_, documents_ and document_ids_
+    EraseDocumentsData({document_id}, words.size());
 
-    //remove from document_to_word_freqs_
-    document_to_word_freqs_.erase(document_id);
+    //remove words no document refers to anymore
+    ReleaseWords(dead_words);
+}
+
+void SearchServer::RemoveDocuments(span<const int> document_ids) {
+    RemoveDocuments(execution::seq, document_ids);
+}
 
-    //remove from documents_
-    documents_.erase(document_id);
+void SearchServer::RemoveDocuments(const execution::sequenced_policy&, span<const int> document_ids) {
+    for (const int document_id : document_ids) {
+        RemoveAlias(document_id);
+    }
+    const vector<int> ids = CollectRemovableDocuments(document_ids);
+
+    //remove from word_to_document_freqs_, one pass per posting list
+    vector<string_view> dead_words;
+    size_t removed_postings = 0;
+    for (const auto& [word, word_ids] : GroupDocumentsByWord(ids)) {
+        removed_postings += word_ids.size();
+        auto& document_freqs = word_to_document_freqs_.at(word);
+        for (const int document_id : word_ids) {
+            document_freqs.erase(document_id);
+        }
+        if (document_freqs.empty()) {
+            dead_words.push_back(word);
+        }
+    }
 
-    //remove from document_ids_
-    document_ids_.erase(document_id);
+    EraseDocumentsData(ids, removed_postings);
+    ReleaseWords(dead_words);
+}
+
+void SearchServer::RemoveDocuments(const execution::parallel_policy& policy, span<const int> document_ids) {
+    for (const int document_id : document_ids) {
+        RemoveAlias(document_id);
+    }
+    const vector<int> ids = CollectRemovableDocuments(document_ids);
+    const auto word_to_ids = GroupDocumentsByWord(ids);
+
+    //every task owns exactly one posting list
+    vector<pair<map<int, double>*, const vector<int>*>> tasks;
+    tasks.reserve(word_to_ids.size());
+    size_t removed_postings = 0;
+    for (const auto& [word, word_ids] : word_to_ids) {
+        tasks.emplace_back(&word_to_document_freqs_.at(word), &word_ids);
+        removed_postings += word_ids.size();
+    }
+
+    for_each(policy, tasks.begin(), tasks.end(),
+        [](const auto& task) {
+            for (const int document_id : *task.second) {
+                task.first->erase(document_id);
+            }
+        });
+
+    vector<string_view> dead_words;
+    for (size_t i = 0; const auto& [word, _] : word_to_ids) {
+        if (tasks[i++].first->empty()) {
+            dead_words.push_back(word);
+        }
+    }
+
+    EraseDocumentsData(ids, removed_postings);
+    ReleaseWords(dead_words);
+}
+
+size_t SearchServer::GetReclaimedBytes() const {
+    return reclaimed_bytes_;
 }
 
 vector<Document> SearchServer::FindTopDocuments(const string_view raw_query, DocumentStatus input_status) const {
@@ -94,6 +343,113 @@ vector<Document> SearchServer::FindTopDocuments(const string_view raw_query, Doc
         });
 }
 
+TopDocumentsResult SearchServer::FindTopDocuments(const string_view raw_query, DocumentStatus input_status,
+    const QueryLimits& limits) const {
+    const Query query = ParseQuery(raw_query);
+    QueryBudget budget(limits);
+    TopDocumentsResult result;
+    result.documents = FindAllDocuments(execution::seq, query,
+        [input_status](int, DocumentStatus status, int) {
+            return status == input_status;
+        },
+        nullptr, &budget);
+    result.truncated = budget.IsExhausted();
+    if (result.truncated && limits.on_expiry == ExpiryPolicy::THROW) {
+        throw QueryInterruptedError("Query limits expired before scoring finished"s);
+    }
+
+    sort(result.documents.begin(), result.documents.end(), IsMoreRelevant);
+    if (result.documents.size() > MAX_RESULT_DOCUMENT_COUNT) {
+        result.documents.resize(MAX_RESULT_DOCUMENT_COUNT);
+    }
+    return result;
+}
+
+vector<vector<Document>> SearchServer::FindTopDocumentsBatch(span<const string_view> raw_queries, DocumentStatus input_status) const {
+    bool truncated = false;
+    return RankBatch(raw_queries, input_status, nullptr, truncated);
+}
+
+vector<TopDocumentsResult> SearchServer::FindTopDocumentsBatch(span<const string_view> raw_queries, DocumentStatus input_status,
+    const QueryLimits& limits) const {
+    bool truncated = false;
+    vector<vector<Document>> documents = RankBatch(raw_queries, input_status, &limits, truncated);
+    if (truncated && limits.on_expiry == ExpiryPolicy::THROW) {
+        throw QueryInterruptedError("Query limits expired before the batch was ranked"s);
+    }
+    vector<TopDocumentsResult> results(documents.size());
+    for (size_t i = 0; i < documents.size(); ++i) {
+        results[i].documents = move(documents[i]);
+        results[i].truncated = truncated;
+    }
+    return results;
+}
+
+vector<vector<Document>> SearchServer::RankBatch(span<const string_view> raw_queries, DocumentStatus input_status,
+    const QueryLimits* limits, bool& truncated) const {
+    const QueryBatch batch = PrepareBatch(raw_queries);
+
+    // id ranges with equal document counts are ranked in parallel
+    const size_t range_count = min<size_t>(max(thread::hardware_concurrency(), 1u), documents_.size());
+    vector<pair<int, int>> ranges;
+    auto document_it = documents_.begin();
+    for (size_t i = 0; i < range_count; ++i) {
+        const size_t range_size = documents_.size() * (i + 1) / range_count - documents_.size() * i / range_count;
+        const int first_id = document_it->first;
+        advance(document_it, range_size - 1);
+        ranges.emplace_back(first_id, document_it->first);
+        ++document_it;
+    }
+    vector<vector<vector<Document>>> range_results(ranges.size());
+    vector<size_t> indexes(ranges.size());
+    iota(indexes.begin(), indexes.end(), 0);
+    atomic<bool> ranges_truncated = false;
+    for_each(execution::par, indexes.begin(), indexes.end(),
+        [this, &batch, &ranges, &range_results, input_status, limits, &ranges_truncated](size_t i) {
+            range_results[i] = RankBatchRange(batch, input_status, ranges[i].first, ranges[i].second, limits, ranges_truncated);
+        });
+    truncated = ranges_truncated;
+
+    vector<vector<Document>> distinct_results(batch.query_count);
+    for (size_t query = 0; query < batch.query_count; ++query) {
+        for (vector<vector<Document>>& tops : range_results) {
+            move(tops[query].begin(), tops[query].end(), back_inserter(distinct_results[query]));
+        }
+        sort(distinct_results[query].begin(), distinct_results[query].end(), IsMoreRelevant);
+        if (distinct_results[query].size() > MAX_RESULT_DOCUMENT_COUNT) {
+            distinct_results[query].resize(MAX_RESULT_DOCUMENT_COUNT);
+        }
+    }
+
+    vector<vector<Document>> results(raw_queries.size());
+    for (size_t i = 0; i < raw_queries.size(); ++i) {
+        results[i] = distinct_results[batch.query_indexes[i]];
+    }
+    return results;
+}
+
+void SearchServer::CollectStatistics(const string_view raw_query, CorpusStatistics& statistics) const {
+    statistics.document_count += GetDocumentCount();
+    for (const string_view word : ParseQuery(raw_query).plus_words) {
+        if (auto it = word_to_document_freqs_.find(word); it != word_to_document_freqs_.end()) {
+            auto freq_it = statistics.document_freqs.find(word);
+            if (freq_it == statistics.document_freqs.end()) {
+                freq_it = statistics.document_freqs.emplace(string(word), 0).first;
+            }
+            freq_it->second += static_cast<int>(it->second.size());
+        }
+    }
+}
+
+bool SearchServer::IsMoreRelevant(const Document& lhs, const Document& rhs) {
+    if (abs(lhs.relevance - rhs.relevance) < 1e-6) {
+        return lhs.rating > rhs.rating;
+    }
+    else {
+        return lhs.relevance > rhs.relevance;
+    }
+}
+
 tuple<vector<string_view>, DocumentStatus> SearchServer::MatchDocument(const string_view raw_query, int document_id) const {
     const SearchServer::Query query = SearchServer::ParseQuery(raw_query);
     vector<string_view> matched_words;
@@ -106,7 +462,7 @@ tuple<vector<string_view>, DocumentStatus> SearchServer::MatchDocument(const str
         auto it = word_to_document_freqs_.find(word);
 
         if (it->second.count(document_id)) {
-            matched_words.push_back(word);
+            matched_words.push_back(it->first);
         }
     }
     for (const string_view word : query.minus_words) {
@@ -138,12 +494,16 @@ tuple<vector<string_view>, DocumentStatus> SearchServer::MatchDocument(const exe
     };
 
     if (any_of(policy, query.minus_words.begin(), query.minus_words.end(), condition)) {
-        return {{}, documents_.at(document_id).status};
+        return {vector<string_view>{}, documents_.at(document_id).status};
     }
 
-    vector<string_view> matched_words;
-
-    copy_if(policy, query.plus_words.begin(), query.plus_words.end(), back_inserter(matched_words), condition);
+    vector<string_view> matched_words(query.plus_words.size());
+    matched_words.erase(copy_if(policy, query.plus_words.begin(), query.plus_words.end(), matched_words.begin(), condition),
+        matched_words.end());
+    // the query words point into raw_query, the dictionary keys outlive it
+    transform(policy, matched_words.begin(), matched_words.end(), matched_words.begin(), [this](const string_view word) {
+        return word_to_document_freqs_.find(word)->first;
+    });
 
     return {matched_words, documents_.at(document_id).status};
 }
@@ -174,6 +534,202 @@ vector<string_view> SearchServer::SplitIntoWordsNoStop(const string_view text) c
     return words;
 }
 
+vector<int> SearchServer::CollectRemovableDocuments(span<const int> document_ids) const {
+    vector<int> ids;
+    ids.reserve(document_ids.size());
+    for (const int document_id : document_ids) {
+        if (documents_.count(document_id)) {
+            ids.push_back(document_id);
+        }
+    }
+
+    sort(ids.begin(), ids.end());
+    ids.erase(unique(ids.begin(), ids.end()), ids.end());
+    return ids;
+}
+
+map<string_view, vector<int>> SearchServer::GroupDocumentsByWord(const vector<int>& document_ids) const {
+    map<string_view, vector<int>> word_to_ids;
+
+    if (options_.use_forward_index) {
+        for (const int document_id : document_ids) {
+            for (const auto [word, _] : GetWordFrequencies(document_id)) {
+                word_to_ids[word].push_back(document_id);
+            }
+        }
+        return word_to_ids;
+    }
+
+    // document_ids are sorted, a single sweep over the postings finds all of them
+    for (const auto& [word, document_freqs] : word_to_document_freqs_) {
+        vector<int> word_ids;
+        if (document_freqs.size() < document_ids.size()) {
+            for (const auto& [document_id, _] : document_freqs) {
+                if (binary_search(document_ids.begin(), document_ids.end(), document_id)) {
+                    word_ids.push_back(document_id);
+                }
+            }
+        }
+        else {
+            for (const int document_id : document_ids) {
+                if (document_freqs.count(document_id)) {
+                    word_ids.push_back(document_id);
+                }
+            }
+        }
+
+        if (!word_ids.empty()) {
+            word_to_ids.emplace(word, move(word_ids));
+        }
+    }
+    return word_to_ids;
+}
+
+vector<string_view> SearchServer::FindDocumentWords(int document_id) const {
+    vector<string_view> words;
+
+    if (options_.use_forward_index) {
+        for (const auto [word, _] : GetWordFrequencies(document_id)) {
+            words.push_back(word);
+        }
+        return words;
+    }
+
+    for (const auto& [word, document_freqs] : word_to_document_freqs_) {
+        if (document_freqs.count(document_id)) {
+            words.push_back(word);
+        }
+    }
+    return words;
+}
+
+optional<int> SearchServer::FindDuplicate(const vector<pair<string_view, double>>& word_freqs) const {
+    vector<uint32_t> word_ids;
+    word_ids.reserve(word_freqs.size());
+    for (const auto& [word, _] : word_freqs) {
+        auto it = words_.find(word);
+        // a new word can't belong to an existing document
+        if (it == words_.end()) {
+            return nullopt;
+        }
+        word_ids.push_back(it->second);
+    }
+
+    sort(word_ids.begin(), word_ids.end());
+
+    auto it = signature_to_documents_.find(ComputeSignature(word_ids));
+    if (it == signature_to_documents_.end()) {
+        return nullopt;
+    }
+    for (const int document_id : it->second) {
+        if (HasWordIds(document_id, word_ids)) {
+            return document_id;
+        }
+    }
+    return nullopt;
+}
+
+// word_ids must be sorted and unique
+bool SearchServer::HasWordIds(int document_id, const vector<uint32_t>& word_ids) const {
+    if (options_.use_forward_index) {
+        const auto entries = document_to_word_freqs_.Get(document_id);
+        return equal(entries.begin(), entries.end(), word_ids.begin(), word_ids.end(),
+            [](const ForwardIndex::Entry& entry, uint32_t word_id) { return entry.word_id == word_id; });
+    }
+
+    vector<uint32_t> document_word_ids;
+    for (const string_view word : FindDocumentWords(document_id)) {
+        document_word_ids.push_back(words_.find(word)->second);
+    }
+    sort(document_word_ids.begin(), document_word_ids.end());
+    return document_word_ids == word_ids;
+}
+
+bool SearchServer::RemoveAlias(int alias_id) {
+    auto it = alias_to_document_.find(alias_id);
+    if (it == alias_to_document_.end()) {
+        return false;
+    }
+
+    auto& aliases = document_to_aliases_.at(it->second);
+    aliases.erase(find(aliases.begin(), aliases.end(), alias_id));
+    if (aliases.empty()) {
+        document_to_aliases_.erase(it->second);
+    }
+    alias_to_document_.erase(it);
+    return true;
+}
+
+// Document count (and therefore IDF) is derived from documents_, so it changes once here
+void SearchServer::EraseDocumentsData(const vector<int>& document_ids, size_t removed_postings) {
+    reclaimed_bytes_ += removed_postings * POSTING_ENTRY_BYTES;
+
+    for (const int document_id : document_ids) {
+        if (options_.duplicate_policy != DuplicatePolicy::ALLOW) {
+            auto signature_it = signature_to_documents_.find(documents_.at(document_id).signature);
+            auto& same_signature_ids = signature_it->second;
+            same_signature_ids.erase(find(same_signature_ids.begin(), same_signature_ids.end(), document_id));
+            if (same_signature_ids.empty()) {
+                signature_to_documents_.erase(signature_it);
+            }
+        }
+
+        if (auto aliases_it = document_to_aliases_.find(document_id); aliases_it != document_to_aliases_.end()) {
+            for (const int alias_id : aliases_it->second) {
+                alias_to_document_.erase(alias_id);
+            }
+            document_to_aliases_.erase(aliases_it);
+        }
+
+        reclaimed_bytes_ += DOCUMENT_ENTRY_BYTES + document_to_word_freqs_.Remove(document_id);
+        documents_.erase(document_id);
+        document_ids_.erase(document_id);
+    }
+}
+
+// Words must not be referenced by any document
+void SearchServer::ReleaseWords(const vector<string_view>& words) {
+    for (const string_view word : words) {
+        word_to_document_freqs_.erase(word);
+
+        auto it = words_.find(word);
+        const uint32_t word_id = it->second;
+        words_.erase(it);
+        id_to_word_[word_id] = {};
+        free_word_ids_.push_back(word_id);
+
+        string& storage = word_storage_[word_id];
+        reclaimed_bytes_ += WORD_ENTRY_BYTES + (storage.capacity() > SSO_CAPACITY ? storage.capacity() + 1 : 0);
+        string().swap(storage);
+    }
+}
+
+// Ids of released words are reused, so the dictionary doesn't grow with the corpus churn
+uint32_t SearchServer::AcquireWordId(const string_view word, bool borrow) {
+    auto it = words_.find(word);
+    if (it != words_.end()) {
+        return it->second;
+    }
+
+    uint32_t word_id = static_cast<uint32_t>(id_to_word_.size());
+    if (!free_word_ids_.empty()) {
+        word_id = free_word_ids_.back();
+        free_word_ids_.pop_back();
+    }
+    else {
+        id_to_word_.emplace_back();
+        word_storage_.emplace_back();
+    }
+
+    string_view key = word;
+    if (!borrow) {
+        key = word_storage_[word_id].assign(word);
+    }
+    words_.emplace(key, word_id);
+    id_to_word_[word_id] = key;
+    return word_id;
+}
+
 int SearchServer::ComputeAverageRating(const vector<int>& ratings) {
     if (ratings.empty()) {
         return 0;
@@ -227,8 +783,136 @@ SearchServer::Query SearchServer::ParseQuery(const string_view text) const {
     return query;
 }
 
-// Existence required
-double SearchServer::ComputeWordInverseDocumentFreq(const string_view word) const {
+SearchServer::QueryBatch SearchServer::PrepareBatch(span<const string_view> raw_queries) const {
+    QueryBatch batch;
+    batch.query_indexes.reserve(raw_queries.size());
+    unordered_map<string_view, size_t> distinct_queries;
+    vector<Query> queries;
+    for (const string_view raw_query : raw_queries) {
+        const auto [it, inserted] = distinct_queries.emplace(raw_query, queries.size());
+        if (inserted) {
+            queries.push_back(ParseQuery(raw_query));
+        }
+        batch.query_indexes.push_back(it->second);
+    }
+    batch.query_count = queries.size();
+
+    // ordered like Query::plus_words, so every document gets its terms added in the order FindAllDocuments uses
+    map<string_view, BatchTerm> terms;
+    for (uint32_t query = 0; query < queries.size(); ++query) {
+        for (const string_view word : queries[query].plus_words) {
+            terms[word].plus_queries.push_back(query);
+        }
+        for (const string_view word : queries[query].minus_words) {
+            terms[word].minus_queries.push_back(query);
+        }
+    }
+    for (auto& [word, term] : terms) {
+        const auto it = word_to_document_freqs_.find(word);
+        if (it == word_to_document_freqs_.end()) {
+            continue;
+        }
+        term.document_freqs = &it->second;
+        term.inverse_document_freq = ComputeWordInverseDocumentFreq(word);
+        batch.terms.push_back(move(term));
+    }
+    return batch;
+}
+
+vector<vector<Document>> SearchServer::RankBatchRange(const QueryBatch& batch, DocumentStatus input_status,
+    int first_id, int last_id, const QueryLimits* limits, atomic<bool>& truncated) const {
+    enum : uint8_t { UNTOUCHED, MATCHED, EXCLUDED };
+
+    const size_t query_count = batch.query_count;
+    const size_t block_size = clamp<size_t>(BATCH_ACCUMULATOR_BYTES / (max<size_t>(query_count, 1) * (sizeof(double) + 1)),
+        64, 1 << 14);
+    // accumulators of query q for the document block_begin + offset are at q * block_size + offset
+    vector<double> relevances(query_count * block_size);
+    vector<uint8_t> states(query_count * block_size, UNTOUCHED);
+    vector<vector<uint32_t>> touched_offsets(query_count);
+    vector<uint32_t> touched_queries;
+    vector<uint8_t> allowed(block_size);
+    vector<int> ratings(block_size);
+    vector<vector<Document>> tops(query_count);
+
+    const auto touch = [&](uint32_t query, uint32_t offset) {
+        if (touched_offsets[query].empty()) {
+            touched_queries.push_back(query);
+        }
+        touched_offsets[query].push_back(offset);
+    };
+
+    vector<map<int, double>::const_iterator> cursors;
+    for (const BatchTerm& term : batch.terms) {
+        cursors.push_back(term.document_freqs->lower_bound(first_id));
+    }
+
+    for (auto document_it = documents_.lower_bound(first_id); document_it != documents_.end() && document_it->first <= last_id;) {
+        if (limits != nullptr && (truncated.load(memory_order_relaxed) || limits->IsExpired())) {
+            truncated = true;
+            break;
+        }
+        // blocks start at a document, the ids between blocks have no documents and no postings
+        const int64_t block_begin = document_it->first;
+        const int64_t block_end = min<int64_t>(block_begin + block_size, int64_t{last_id} + 1);
+        fill(allowed.begin(), allowed.end(), 0);
+        for (; document_it != documents_.end() && document_it->first < block_end; ++document_it) {
+            allowed[document_it->first - block_begin] = document_it->second.status == input_status;
+            ratings[document_it->first - block_begin] = document_it->second.rating;
+        }
+
+        for (size_t i = 0; i < batch.terms.size(); ++i) {
+            const BatchTerm& term = batch.terms[i];
+            auto& cursor = cursors[i];
+            for (; cursor != term.document_freqs->end() && cursor->first < block_end; ++cursor) {
+                const uint32_t offset = static_cast<uint32_t>(cursor->first - block_begin);
+                for (const uint32_t query : term.minus_queries) {
+                    uint8_t& state = states[query * block_size + offset];
+                    if (state == UNTOUCHED) {
+                        touch(query, offset);
+                    }
+                    state = EXCLUDED;
+                }
+                if (!allowed[offset]) {
+                    continue;
+                }
+                const double relevance = cursor->second * term.inverse_document_freq;
+                for (const uint32_t query : term.plus_queries) {
+                    const size_t index = query * block_size + offset;
+                    if (states[index] == UNTOUCHED) {
+                        states[index] = MATCHED;
+                        relevances[index] = 0.0;
+                        touch(query, offset);
+                    }
+                    relevances[index] += relevance;
+                }
+            }
+        }
+
+        for (const uint32_t query : touched_queries) {
+            for (const uint32_t offset : touched_offsets[query]) {
+                const size_t index = query * block_size + offset;
+                if (states[index] == MATCHED) {
+                    InsertTopDocument(tops[query], {static_cast<int>(block_begin + offset), relevances[index], ratings[offset]});
+                }
+                states[index] = UNTOUCHED;
+            }
+            touched_offsets[query].clear();
+        }
+        touched_queries.clear();
+    }
+    return tops;
+}
+
+bool SearchServer::HasStatistics(const string_view word, const CorpusStatistics* statistics) const {
+    return statistics == nullptr || statistics->document_freqs.count(word) != 0;
+}
+
+// Existence required, in statistics too if it is given
+double SearchServer::ComputeWordInverseDocumentFreq(const string_view word, const CorpusStatistics* statistics) const {
+    if (statistics != nullptr) {
+        return log(statistics->document_count * 1.0 / statistics->document_freqs.find(word)->second);
+    }
     auto it = word_to_document_freqs_.find(word);
     return log(SearchServer::GetDocumentCount() * 1.0 / it->second.size());
 }
@@ -2,16 +2,28 @@
 
 #include "concurrent_map.h"
 #include "document.h"
+#include "document_signature.h"
+#include "forward_index.h"
+#include "mapped_file.h"
+#include "query_limits.h"
 #include "string_processing.h"
 
 #include <algorithm>
+#include <array>
+#include <atomic>
 #include <cmath>
+#include <deque>
 #include <execution>
 #include <functional>
 #include <future>
 #include <iostream>
 #include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
 #include <set>
+#include <shared_mutex>
+#include <span>
 #include <stdexcept>
 #include <string_view>
 #include <vector>
@@ -19,35 +31,171 @@
 const int MAX_RESULT_DOCUMENT_COUNT = 5;
 const int CONCURRENT_BUCKET_COUNT = 10000;
 
+// What AddDocument does with a document whose set of words matches an existing document
+enum class DuplicatePolicy {
+    ALLOW,
+    // throw std::invalid_argument
+    REJECT,
+    // don't index the document, remember its id as an alias of the original
+    ALIAS,
+};
+
+struct SearchServerOptions {
+    // Without the forward index GetWordFrequencies is unavailable
+    // and removals have to scan every posting list
+    bool use_forward_index = true;
+    DuplicatePolicy duplicate_policy = DuplicatePolicy::ALLOW;
+};
+
+// Text the caller guarantees to stay alive and unchanged for the whole lifetime of the
+// SearchServer it is added to. Words of such documents are not copied,
+// the dictionary refers into the text directly
+class StableText {
+public:
+    explicit StableText(std::string_view text)
+        : text_(text) { }
+
+    std::string_view View() const {
+        return text_;
+    }
+
+    StableText substr(size_t pos, size_t count = std::string_view::npos) const {
+        return StableText(text_.substr(pos, count));
+    }
+
+private:
+    std::string_view text_;
+};
+
+// Tokenized document, the output of SearchServer::PrepareDocument.
+// Words point into the source text, which must stay alive until the document is added
+struct PreparedDocument {
+    int document_id = 0;
+    DocumentStatus status = DocumentStatus::ACTUAL;
+    int rating = 0;
+    // Unique words in lexicographic order with their term frequencies
+    std::vector<std::pair<std::string_view, double>> word_freqs;
+    // Set when prepared from StableText
+    bool borrow_words = false;
+};
+
+// Document counts of a corpus split over several servers, see ShardedSearchServer.
+// Servers given these statistics compute IDF as if they held the whole corpus
+struct CorpusStatistics {
+    int document_count = 0;
+    // Number of documents containing each word
+    std::map<std::string, int, std::less<>> document_freqs;
+};
+
+// Estimated heap usage of the index, in bytes
+struct IndexMemoryUsage {
+    size_t postings = 0;
+    size_t forward_index = 0;
+    size_t dictionary = 0;
+    size_t documents = 0;
+
+    size_t Total() const {
+        return postings + forward_index + dictionary + documents;
+    }
+};
+
 class SearchServer {
 public:
     template <typename StringContainer>
-    explicit SearchServer(const StringContainer& stop_words);
+    explicit SearchServer(const StringContainer& stop_words, SearchServerOptions options = {});
 
-    explicit SearchServer(const std::string& stop_words_text)
-        : SearchServer(SplitIntoWords(stop_words_text)) { }
+    explicit SearchServer(const std::string& stop_words_text, SearchServerOptions options = {})
+        : SearchServer(SplitIntoWords(stop_words_text), options) { }
 
-    explicit SearchServer(const std::string_view stop_words_text)
-        : SearchServer(SplitIntoWordsView(stop_words_text)) { }
+    explicit SearchServer(const std::string_view stop_words_text, SearchServerOptions options = {})
+        : SearchServer(SplitIntoWordsView(stop_words_text), options) { }
 
     int GetDocumentCount() const;
 
-    const std::map<std::string_view, double>& GetWordFrequencies(int document_id) const;
+    const SearchServerOptions& GetOptions() const;
+
+    // The view stays valid until the next modification of the server.
+    // Throws std::logic_error if the forward index is disabled
+    WordFrequenciesView GetWordFrequencies(int document_id) const;
+
+    IndexMemoryUsage GetMemoryUsage() const;
+
+    // Fingerprint of the document's set of words, computed when the document is added
+    DocumentSignature GetDocumentSignature(int document_id) const;
+
+    // Exact comparison of the word sets of two documents
+    bool HaveSameWords(int lhs_document_id, int rhs_document_id) const;
+
+    // Writes the whole index to a versioned, checksummed, page-aligned binary file.
+    // log_sequence_number marks the last write-ahead log record the index contains.
+    // Throws std::runtime_error on I/O errors
+    void SaveSnapshot(const std::string& path, uint64_t log_sequence_number = 0) const;
+
+    // Restores a server from SaveSnapshot output without re-tokenizing the documents.
+    // Throws std::runtime_error if the file is damaged or has an unsupported version
+    static SearchServer LoadSnapshot(const std::string& path);
+
+    // Id of the indexed document the alias refers to, see DuplicatePolicy::ALIAS.
+    // Aliases are removed together with their original document
+    std::optional<int> FindAliasOriginal(int alias_id) const;
 
     std::set<int>::const_iterator begin() const;
 
     std::set<int>::const_iterator end() const;
 
+    // AddDocument overloads may be called from several threads at once, the document id is checked
+    // and reserved atomically. No other method may run concurrently with them
     void AddDocument(int document_id, const std::string_view document, DocumentStatus status, const std::vector<int>& ratings);
 
+    // Zero-copy ingestion, see StableText for the lifetime contract
+    void AddDocument(int document_id, StableText document, DocumentStatus status, const std::vector<int>& ratings);
+
+    // Tokenizes and validates a document without touching the index, so it is safe to call
+    // from several threads while no other thread modifies the stop words.
+    // Throws std::invalid_argument if the text contains invalid symbols
+    PreparedDocument PrepareDocument(int document_id, const std::string_view document, DocumentStatus status,
+        const std::vector<int>& ratings) const;
+
+    PreparedDocument PrepareDocument(int document_id, StableText document, DocumentStatus status,
+        const std::vector<int>& ratings) const;
+
+    // The second half of AddDocument: checks the id and the duplicate policy and updates the index.
+    // Words of one document are added under striped posting locks, so writers mostly run in parallel.
+    // With a duplicate policy other than ALLOW the commits are serialized
+    void AddDocument(PreparedDocument document);
+
+    // Maps the file into memory for the lifetime of the server (and of its copies),
+    // so its pieces can be added as StableText. Throws std::runtime_error if the file can't be mapped
+    StableText MapCorpus(const std::string& path);
+
+    // Takes over an existing mapping, with the same lifetime as above
+    StableText MapCorpus(MappedFile file);
+
     void RemoveDocument(int document_id);
 
     void RemoveDocument(const std::execution::sequenced_policy& policy, int document_id);
 
     void RemoveDocument(const std::execution::parallel_policy& policy, int document_id);
 
+    // Removes a batch of documents, rewriting every affected posting list once.
+    // Unknown and repeated ids are ignored
+    void RemoveDocuments(std::span<const int> document_ids);
+
+    void RemoveDocuments(const std::execution::sequenced_policy& policy, std::span<const int> document_ids);
+
+    // Posting lists are partitioned by word, so no two threads touch the same list
+    void RemoveDocuments(const std::execution::parallel_policy& policy, std::span<const int> document_ids);
+
+    // Estimated number of bytes released by removals since construction.
+    // Words are dropped from the vocabulary as soon as no document contains them
+    size_t GetReclaimedBytes() const;
+
     std::vector<Document> FindTopDocuments(const std::string_view raw_query, DocumentStatus input_status = DocumentStatus::ACTUAL) const;
 
+    // Scores until the limits expire, they are checked every QueryBudget::CHECK_INTERVAL postings.
+    // With ExpiryPolicy::THROW an expired query throws QueryInterruptedError instead of returning
+    TopDocumentsResult FindTopDocuments(const std::string_view raw_query, DocumentStatus input_status, const QueryLimits& limits) const;
+
     template <typename Comparator>
     std::vector<Document> FindTopDocuments(const std::string_view raw_query, Comparator comp) const;
 
@@ -57,6 +205,32 @@ public:
     template <typename ExecutionPolicy, typename Comparator>
     std::vector<Document> FindTopDocuments(const ExecutionPolicy& policy, const std::string_view raw_query, Comparator comp) const;
 
+    // Ranks with the IDF of the whole corpus. Words missing from statistics, e.g. added after
+    // they were collected, match no documents
+    template <typename ExecutionPolicy, typename Comparator>
+    std::vector<Document> FindTopDocuments(const ExecutionPolicy& policy, const std::string_view raw_query, Comparator comp,
+        const CorpusStatistics& statistics) const;
+
+    // Ranks a batch of queries like FindTopDocuments(raw_query, input_status). All the queries are parsed before
+    // ranking starts, identical queries are ranked once, and the posting list of every distinct word is scanned
+    // once for all the queries containing it, block by block of document ids.
+    // Documents that compare equal may come in another order than from FindTopDocuments.
+    // Result i answers raw_queries[i]. Throws std::invalid_argument for the first invalid query
+    std::vector<std::vector<Document>> FindTopDocumentsBatch(std::span<const std::string_view> raw_queries,
+        DocumentStatus input_status = DocumentStatus::ACTUAL) const;
+
+    // The limits apply to the whole batch and are checked before every block of document ids,
+    // so all the queries of an expired batch are truncated together
+    std::vector<TopDocumentsResult> FindTopDocumentsBatch(std::span<const std::string_view> raw_queries,
+        DocumentStatus input_status, const QueryLimits& limits) const;
+
+    // Adds the document count and the document frequencies of the query plus words to statistics
+    void CollectStatistics(const std::string_view raw_query, CorpusStatistics& statistics) const;
+
+    // Result order of FindTopDocuments: by relevance, then by rating when relevances are nearly equal
+    static bool IsMoreRelevant(const Document& lhs, const Document& rhs);
+
+    // The matched words point into the server's dictionary, so they outlive the query text
     std::tuple<std::vector<std::string_view>, DocumentStatus> MatchDocument(const std::string_view raw_query, int document_id) const;
 
     std::tuple<std::vector<std::string_view>, DocumentStatus> MatchDocument(const std::execution::sequenced_policy& policy, const std::string_view raw_query, int document_id) const;
@@ -67,6 +241,39 @@ private:
     struct DocumentData {
         int rating = 0;
         DocumentStatus status = DocumentStatus::ACTUAL;
+        DocumentSignature signature;
+    };
+
+    // Approximate heap footprint of the index containers, used for memory accounting.
+    // A red-black tree node carries a colour and three pointers besides the value
+    static constexpr size_t TREE_NODE_OVERHEAD = 4 * sizeof(void*);
+    static constexpr size_t SSO_CAPACITY = 15;
+    static constexpr size_t POSTING_ENTRY_BYTES = TREE_NODE_OVERHEAD + sizeof(std::pair<const int, double>);
+    static constexpr size_t DOCUMENT_ENTRY_BYTES = 2 * TREE_NODE_OVERHEAD + sizeof(std::pair<const int, DocumentData>)
+        + sizeof(int);
+    static constexpr size_t WORD_ENTRY_BYTES = 2 * TREE_NODE_OVERHEAD + sizeof(std::pair<const std::string_view, uint32_t>)
+        + sizeof(std::pair<const std::string_view, std::map<int, double>>);
+
+    static constexpr size_t POSTING_LOCK_COUNT = 64;
+
+    // Locks taken by concurrent AddDocument calls. A copy of the server gets its own locks
+    struct WriterLocks {
+        WriterLocks() = default;
+
+        WriterLocks(const WriterLocks&) { }
+
+        WriterLocks& operator=(const WriterLocks&) {
+            return *this;
+        }
+
+        // documents_, document_ids_, aliases and signatures
+        std::mutex documents;
+        // words_, id_to_word_, word_storage_, free_word_ids_ and the set of keys of word_to_document_freqs_
+        std::shared_mutex dictionary;
+        // a posting list is guarded by the lock with index word_id % POSTING_LOCK_COUNT
+        std::array<std::mutex, POSTING_LOCK_COUNT> postings;
+        std::mutex forward_index;
+        std::mutex deduplication;
     };
 
     struct QueryWord {
@@ -80,6 +287,26 @@ private:
         std::set<std::string_view> minus_words;
     };
 
+    // A word of a query batch with the queries that contain it
+    struct BatchTerm {
+        const std::map<int, double>* document_freqs = nullptr;
+        double inverse_document_freq = 0.0;
+        std::vector<uint32_t> plus_queries;
+        std::vector<uint32_t> minus_queries;
+    };
+
+    // Parsed queries of a batch grouped by word
+    struct QueryBatch {
+        size_t query_count = 0;
+        // Index of the distinct query of every raw query
+        std::vector<size_t> query_indexes;
+        // Words known to the index, in the order of Query::plus_words
+        std::vector<BatchTerm> terms;
+    };
+
+    // Accumulators of one block of document ids are kept under this size, so they stay in the cache
+    static constexpr size_t BATCH_ACCUMULATOR_BYTES = 1 << 20;
+
 private:
     bool IsStopWord(const std::string_view word) const ;
 
@@ -93,29 +320,86 @@ private:
 
     Query ParseQuery(const std::string_view text) const;
 
-    // Existence required
-    double ComputeWordInverseDocumentFreq(const std::string_view word) const;
+    QueryBatch PrepareBatch(std::span<const std::string_view> raw_queries) const;
+
+    // Sets truncated if the limits expire before every document is ranked
+    std::vector<std::vector<Document>> RankBatch(std::span<const std::string_view> raw_queries, DocumentStatus input_status,
+        const QueryLimits* limits, bool& truncated) const;
+
+    // Top documents of every query of the batch among the document ids in [first_id, last_id].
+    // Ranges ranked in parallel share truncated, so they all stop once one of them sees the limits expire
+    std::vector<std::vector<Document>> RankBatchRange(const QueryBatch& batch, DocumentStatus input_status,
+        int first_id, int last_id, const QueryLimits* limits, std::atomic<bool>& truncated) const;
+
+    // A word added to this server after the statistics were collected matches no documents
+    bool HasStatistics(const std::string_view word, const CorpusStatistics* statistics) const;
+
+    // Existence required, in statistics too if it is given
+    double ComputeWordInverseDocumentFreq(const std::string_view word, const CorpusStatistics* statistics = nullptr) const;
+
+    template <typename ExecutionPolicy, typename Comparator>
+    std::vector<Document> RankDocuments(const ExecutionPolicy& policy, const std::string_view raw_query, Comparator comp,
+        const CorpusStatistics* statistics) const;
+
+    std::vector<int> CollectRemovableDocuments(std::span<const int> document_ids) const;
+
+    std::map<std::string_view, std::vector<int>> GroupDocumentsByWord(const std::vector<int>& document_ids) const;
+
+    // Uses the forward index if enabled, otherwise scans all posting lists
+    std::vector<std::string_view> FindDocumentWords(int document_id) const;
+
+    // Looks the words up in the signature table, words aren't added to the dictionary
+    std::optional<int> FindDuplicate(const std::vector<std::pair<std::string_view, double>>& word_freqs) const;
+
+    bool HasWordIds(int document_id, const std::vector<uint32_t>& word_ids) const;
+
+    bool RemoveAlias(int alias_id);
+
+    void EraseDocumentsData(const std::vector<int>& document_ids, size_t removed_postings);
+
+    void ReleaseWords(const std::vector<std::string_view>& words);
+
+    // A borrowed word is referenced in place, otherwise it is copied to word_storage_
+    uint32_t AcquireWordId(const std::string_view word, bool borrow);
 
     template <typename Comparator>
     std::vector<Document> FindAllDocuments(const Query& query, Comparator comp) const;
 
+    // Stops adding postings once the budget is exhausted
     template <typename Comparator>
-    std::vector<Document> FindAllDocuments(const std::execution::sequenced_policy& policy, const Query& query, Comparator comp) const;
+    std::vector<Document> FindAllDocuments(const std::execution::sequenced_policy& policy, const Query& query, Comparator comp,
+        const CorpusStatistics* statistics = nullptr, QueryBudget* budget = nullptr) const;
 
     template <typename Comparator>
-    std::vector<Document> FindAllDocuments(const std::execution::parallel_policy& policy, const Query& query, Comparator comp) const;
+    std::vector<Document> FindAllDocuments(const std::execution::parallel_policy& policy, const Query& query, Comparator comp,
+        const CorpusStatistics* statistics = nullptr) const;
 
 private:
+    SearchServerOptions options_;
     std::set<std::string, std::less<>> stop_words_;
     std::map<std::string_view, std::map<int, double>> word_to_document_freqs_;
     std::map<int, DocumentData> documents_;
     std::set<int> document_ids_;
-    std::map<int, std::map<std::string_view, double>> document_to_word_freqs_;
-    std::set<std::string, std::less<>> words_;
+    ForwardIndex document_to_word_freqs_;
+    // Maps each word to its id in the forward index. Keys point into word_storage_
+    // or into the StableText the word was first seen in
+    std::map<std::string_view, uint32_t> words_;
+    std::vector<std::string_view> id_to_word_;
+    // Indexed by word id, empty for borrowed words. A deque never moves its elements
+    std::deque<std::string> word_storage_;
+    std::vector<std::shared_ptr<const MappedFile>> corpora_;
+    WriterLocks writer_locks_;
+    std::vector<uint32_t> free_word_ids_;
+    // Maintained only if duplicates aren't allowed
+    std::map<DocumentSignature, std::vector<int>> signature_to_documents_;
+    std::map<int, int> alias_to_document_;
+    std::map<int, std::vector<int>> document_to_aliases_;
+    size_t reclaimed_bytes_ = 0;
 };
 
 template <typename StringContainer>
-SearchServer::SearchServer(const StringContainer& stop_words) {
+SearchServer::SearchServer(const StringContainer& stop_words, SearchServerOptions options)
+    : options_(options) {
     for (const std::string_view word : stop_words) {
         if (!SearchServer::IsValidWord(word)) {
             throw std::invalid_argument("Stop word contains invalid symbol");
@@ -142,18 +426,22 @@ std::vector<Document> SearchServer::FindTopDocuments(const std::string_view raw_
 
 template <typename ExecutionPolicy, typename Comparator>
 std::vector<Document> SearchServer::FindTopDocuments(const ExecutionPolicy& policy, const std::string_view raw_query, Comparator comp) const {
+    return SearchServer::RankDocuments(policy, raw_query, comp, nullptr);
+}
+
+template <typename ExecutionPolicy, typename Comparator>
+std::vector<Document> SearchServer::FindTopDocuments(const ExecutionPolicy& policy, const std::string_view raw_query, Comparator comp,
+    const CorpusStatistics& statistics) const {
+    return SearchServer::RankDocuments(policy, raw_query, comp, &statistics);
+}
+
+template <typename ExecutionPolicy, typename Comparator>
+std::vector<Document> SearchServer::RankDocuments(const ExecutionPolicy& policy, const std::string_view raw_query, Comparator comp,
+    const CorpusStatistics* statistics) const {
     const SearchServer::Query query = SearchServer::ParseQuery(raw_query);
-    auto matched_documents = SearchServer::FindAllDocuments(policy, query, comp);
+    auto matched_documents = SearchServer::FindAllDocuments(policy, query, comp, statistics);
 
-    sort(policy, matched_documents.begin(), matched_documents.end(),
-        [](const Document& lhs, const Document& rhs) {
-            if (std::abs(lhs.relevance - rhs.relevance) < 1e-6) {
-                return lhs.rating > rhs.rating;
-            }
-            else {
-                return lhs.relevance > rhs.relevance;
-            }
-        });
+    sort(policy, matched_documents.begin(), matched_documents.end(), IsMoreRelevant);
 
     if (matched_documents.size() > MAX_RESULT_DOCUMENT_COUNT) {
         matched_documents.resize(MAX_RESULT_DOCUMENT_COUNT);
@@ -167,18 +455,26 @@ std::vector<Document> SearchServer::FindAllDocuments(const SearchServer::Query&
 }
 
 template <typename Comparator>
-std::vector<Document> SearchServer::FindAllDocuments(const std::execution::sequenced_policy& policy, const SearchServer::Query& query, Comparator comp) const {
+std::vector<Document> SearchServer::FindAllDocuments(const std::execution::sequenced_policy& policy, const SearchServer::Query& query, Comparator comp,
+    const CorpusStatistics* statistics, QueryBudget* budget) const {
     std::map<int, double> document_to_relevance;
 
     for (const std::string_view word : query.plus_words) {
-        if (word_to_document_freqs_.count(word) == 0) {
+        // the scan stops as a whole once the limits expire
+        if (budget != nullptr && budget->IsExhausted()) {
+            break;
+        }
+        if (word_to_document_freqs_.count(word) == 0 || !HasStatistics(word, statistics)) {
             continue;
         }
 
-        const double inverse_document_freq = SearchServer::ComputeWordInverseDocumentFreq(word);
+        const double inverse_document_freq = SearchServer::ComputeWordInverseDocumentFreq(word, statistics);
         auto it = word_to_document_freqs_.find(word);
 
         for (const auto [document_id, term_freq] : it->second) {
+            if (budget != nullptr && budget->Exhausted()) {
+                break;
+            }
             const auto &document_data = documents_.at(document_id);
 
             if (comp(document_id, document_data.status, document_data.rating)) {
@@ -187,15 +483,26 @@ std::vector<Document> SearchServer::FindAllDocuments(const std::execution::seque
         }
     }
 
-    for (const std::string_view word : query.minus_words) {
-        if (word_to_document_freqs_.count(word) == 0) {
-            continue;
-        }
+    if (budget != nullptr && budget->IsExhausted()) {
+        // the lists of minus words aren't scanned past the limits either, candidates are looked up in them instead
+        std::erase_if(document_to_relevance, [this, &query](const auto& entry) {
+            return std::any_of(query.minus_words.begin(), query.minus_words.end(), [this, &entry](const std::string_view word) {
+                const auto it = word_to_document_freqs_.find(word);
+                return it != word_to_document_freqs_.end() && it->second.count(entry.first) != 0;
+            });
+        });
+    }
+    else {
+        for (const std::string_view word : query.minus_words) {
+            if (word_to_document_freqs_.count(word) == 0) {
+                continue;
+            }
 
-        auto it = word_to_document_freqs_.find(word);
+            auto it = word_to_document_freqs_.find(word);
 
-        for (const auto [document_id, _] : it->second) {
-            document_to_relevance.erase(document_id);
+            for (const auto& [document_id, _] : it->second) {
+                document_to_relevance.erase(document_id);
+            }
         }
     }
 
@@ -212,7 +519,8 @@ std::vector<Document> SearchServer::FindAllDocuments(const std::execution::seque
 }
 
 template <typename Comparator>
-std::vector<Document> SearchServer::FindAllDocuments(const std::execution::parallel_policy& policy, const SearchServer::Query& query, Comparator comp) const {
+std::vector<Document> SearchServer::FindAllDocuments(const std::execution::parallel_policy& policy, const SearchServer::Query& query, Comparator comp,
+    const CorpusStatistics* statistics) const {
     ConcurrentMap<int, double> document_to_relevance(CONCURRENT_BUCKET_COUNT);
     ConcurrentSet<int> id_docs_minus(CONCURRENT_BUCKET_COUNT);
 
@@ -231,9 +539,9 @@ std::vector<Document> SearchServer::FindAllDocuments(const std::execution::paral
     auto part_begin = query.plus_words.begin();
     auto part_end = std::next(part_begin, part_length);
 
-    auto function = [this, &document_to_relevance, &id_docs_minus, &comp](const std::string_view word) {
-        if (word_to_document_freqs_.count(word) != 0) {
-            const double inverse_document_freq = SearchServer::ComputeWordInverseDocumentFreq(word);
+    auto function = [this, &document_to_relevance, &id_docs_minus, &comp, statistics](const std::string_view word) {
+        if (word_to_document_freqs_.count(word) != 0 && HasStatistics(word, statistics)) {
+            const double inverse_document_freq = SearchServer::ComputeWordInverseDocumentFreq(word, statistics);
             auto it = word_to_document_freqs_.find(word);
 
             for (const auto [document_id, term_freq] : it->second) {
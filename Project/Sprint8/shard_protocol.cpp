@@ -0,0 +1,242 @@
+#include "shard_protocol.h"
+
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+using namespace std;
+
+namespace {
+
+template <typename T>
+void AppendValue(string& out, T value) {
+    out.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+void AppendString(string& out, string_view text) {
+    AppendValue(out, static_cast<uint32_t>(text.size()));
+    out += text;
+}
+
+// Bounds-checked reading of a message payload
+class PayloadReader {
+public:
+    explicit PayloadReader(string_view payload)
+        : payload_(payload) {
+    }
+
+    template <typename T>
+    T Take() {
+        T value;
+        if (payload_.size() < sizeof(value)) {
+            throw runtime_error("Shard message is truncated"s);
+        }
+        memcpy(&value, payload_.data(), sizeof(value));
+        payload_.remove_prefix(sizeof(value));
+        return value;
+    }
+
+    string TakeString() {
+        const uint32_t size = Take<uint32_t>();
+        if (payload_.size() < size) {
+            throw runtime_error("Shard message is truncated"s);
+        }
+        string result(payload_.substr(0, size));
+        payload_.remove_prefix(size);
+        return result;
+    }
+
+    DocumentStatus TakeStatus() {
+        const uint8_t status = Take<uint8_t>();
+        if (status > static_cast<uint8_t>(DocumentStatus::REMOVED)) {
+            throw runtime_error("Shard message has invalid document status"s);
+        }
+        return static_cast<DocumentStatus>(status);
+    }
+
+    // Counts are checked against the remaining bytes so a damaged count can't cause a huge allocation
+    uint32_t TakeCount(size_t min_item_size) {
+        const uint32_t count = Take<uint32_t>();
+        if (count > payload_.size() / min_item_size) {
+            throw runtime_error("Shard message is truncated"s);
+        }
+        return count;
+    }
+
+    void ExpectEnd() const {
+        if (!payload_.empty()) {
+            throw runtime_error("Shard message has trailing bytes"s);
+        }
+    }
+
+private:
+    string_view payload_;
+};
+
+void AppendStatistics(string& out, const CorpusStatistics& statistics) {
+    AppendValue(out, static_cast<int32_t>(statistics.document_count));
+    AppendValue(out, static_cast<uint32_t>(statistics.document_freqs.size()));
+    for (const auto& [word, document_freq] : statistics.document_freqs) {
+        AppendString(out, word);
+        AppendValue(out, static_cast<int32_t>(document_freq));
+    }
+}
+
+CorpusStatistics TakeStatistics(PayloadReader& reader) {
+    CorpusStatistics statistics;
+    statistics.document_count = reader.Take<int32_t>();
+    const uint32_t word_count = reader.TakeCount(sizeof(uint32_t) + sizeof(int32_t));
+    for (uint32_t i = 0; i < word_count; ++i) {
+        string word = reader.TakeString();
+        statistics.document_freqs[move(word)] = reader.Take<int32_t>();
+    }
+    return statistics;
+}
+
+void ReadExactly(int fd, char* data, size_t size) {
+    size_t done = 0;
+    while (done < size) {
+        const ssize_t result = read(fd, data + done, size - done);
+        if (result < 0 && errno == EINTR) {
+            continue;
+        }
+        if (result < 0) {
+            throw runtime_error("Can't read shard message: "s + strerror(errno));
+        }
+        if (result == 0) {
+            throw runtime_error("Connection closed in the middle of a shard message"s);
+        }
+        done += static_cast<size_t>(result);
+    }
+}
+
+}  // namespace
+
+void EncodeShardMessage(const ShardMessage& message, string& out) {
+    string payload;
+    switch (message.type) {
+    case ShardMessageType::STATISTICS_REQUEST:
+        AppendString(payload, message.query);
+        break;
+    case ShardMessageType::STATISTICS_RESPONSE:
+        AppendStatistics(payload, message.statistics);
+        break;
+    case ShardMessageType::SEARCH_REQUEST:
+        AppendString(payload, message.query);
+        AppendValue(payload, static_cast<uint8_t>(message.status));
+        AppendStatistics(payload, message.statistics);
+        break;
+    case ShardMessageType::SEARCH_RESPONSE:
+        AppendValue(payload, static_cast<uint32_t>(message.documents.size()));
+        for (const Document& document : message.documents) {
+            AppendValue(payload, static_cast<int32_t>(document.id));
+            AppendValue(payload, document.relevance);
+            AppendValue(payload, static_cast<int32_t>(document.rating));
+        }
+        break;
+    case ShardMessageType::INVALID_QUERY_RESPONSE:
+        AppendString(payload, message.error);
+        break;
+    }
+    if (payload.size() > MAX_SHARD_MESSAGE_SIZE) {
+        throw invalid_argument("Shard message is too large"s);
+    }
+
+    AppendValue(out, static_cast<uint32_t>(payload.size()));
+    AppendValue(out, static_cast<uint8_t>(message.type));
+    out += payload;
+}
+
+size_t GetShardFrameSize(string_view data) {
+    if (data.size() < SHARD_FRAME_HEADER_SIZE) {
+        return 0;
+    }
+    uint32_t payload_size = 0;
+    memcpy(&payload_size, data.data(), sizeof(payload_size));
+    if (payload_size > MAX_SHARD_MESSAGE_SIZE) {
+        throw runtime_error("Shard message is too large"s);
+    }
+    return SHARD_FRAME_HEADER_SIZE + payload_size;
+}
+
+ShardMessage DecodeShardMessage(string_view frame) {
+    if (GetShardFrameSize(frame) != frame.size() || frame.size() == 0) {
+        throw runtime_error("Shard frame is incomplete"s);
+    }
+    const uint8_t type = static_cast<uint8_t>(frame[sizeof(uint32_t)]);
+    PayloadReader reader(frame.substr(SHARD_FRAME_HEADER_SIZE));
+
+    ShardMessage message;
+    switch (type) {
+    case static_cast<uint8_t>(ShardMessageType::STATISTICS_REQUEST):
+        message.query = reader.TakeString();
+        break;
+    case static_cast<uint8_t>(ShardMessageType::STATISTICS_RESPONSE):
+        message.statistics = TakeStatistics(reader);
+        break;
+    case static_cast<uint8_t>(ShardMessageType::SEARCH_REQUEST):
+        message.query = reader.TakeString();
+        message.status = reader.TakeStatus();
+        message.statistics = TakeStatistics(reader);
+        break;
+    case static_cast<uint8_t>(ShardMessageType::SEARCH_RESPONSE): {
+        const uint32_t count = reader.TakeCount(sizeof(int32_t) + sizeof(double) + sizeof(int32_t));
+        message.documents.reserve(count);
+        for (uint32_t i = 0; i < count; ++i) {
+            const int id = reader.Take<int32_t>();
+            const double relevance = reader.Take<double>();
+            message.documents.emplace_back(id, relevance, reader.Take<int32_t>());
+        }
+        break;
+    }
+    case static_cast<uint8_t>(ShardMessageType::INVALID_QUERY_RESPONSE):
+        message.error = reader.TakeString();
+        break;
+    default:
+        throw runtime_error("Unknown shard message type "s + to_string(type));
+    }
+    reader.ExpectEnd();
+    message.type = static_cast<ShardMessageType>(type);
+    return message;
+}
+
+bool ReceiveShardMessage(int fd, ShardMessage& message) {
+    string frame(SHARD_FRAME_HEADER_SIZE, '\0');
+    // a close before the first byte is the normal end of a connection
+    ssize_t result = 0;
+    do {
+        result = read(fd, frame.data(), 1);
+    } while (result < 0 && errno == EINTR);
+    if (result == 0) {
+        return false;
+    }
+    if (result < 0) {
+        throw runtime_error("Can't read shard message: "s + strerror(errno));
+    }
+    ReadExactly(fd, frame.data() + 1, SHARD_FRAME_HEADER_SIZE - 1);
+
+    frame.resize(GetShardFrameSize(frame));
+    ReadExactly(fd, frame.data() + SHARD_FRAME_HEADER_SIZE, frame.size() - SHARD_FRAME_HEADER_SIZE);
+    message = DecodeShardMessage(frame);
+    return true;
+}
+
+void SendShardMessage(int fd, const ShardMessage& message) {
+    string frame;
+    EncodeShardMessage(message, frame);
+    size_t sent = 0;
+    while (sent < frame.size()) {
+        // MSG_NOSIGNAL: a vanished coordinator is an error, not a SIGPIPE
+        const ssize_t result = send(fd, frame.data() + sent, frame.size() - sent, MSG_NOSIGNAL);
+        if (result < 0 && errno == EINTR) {
+            continue;
+        }
+        if (result < 0) {
+            throw runtime_error("Can't send shard message: "s + strerror(errno));
+        }
+        sent += static_cast<size_t>(result);
+    }
+}
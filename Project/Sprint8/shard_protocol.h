@@ -0,0 +1,52 @@
+#pragma once
+
+#include "document.h"
+#include "search_server.h"
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Binary protocol between a SearchCoordinator and shard processes.
+// Every message is a frame: payload size (uint32), message type (uint8), payload.
+// Integers are in the host byte order, both sides run on the same machine
+enum class ShardMessageType : uint8_t {
+    STATISTICS_REQUEST = 1,
+    STATISTICS_RESPONSE = 2,
+    SEARCH_REQUEST = 3,
+    SEARCH_RESPONSE = 4,
+    // The query can't be parsed, the payload is the error message
+    INVALID_QUERY_RESPONSE = 5,
+};
+
+const size_t SHARD_FRAME_HEADER_SIZE = sizeof(uint32_t) + sizeof(uint8_t);
+const size_t MAX_SHARD_MESSAGE_SIZE = 64 << 20;
+
+struct ShardMessage {
+    ShardMessageType type = ShardMessageType::STATISTICS_REQUEST;
+    // Requests
+    std::string query;
+    DocumentStatus status = DocumentStatus::ACTUAL;
+    // SEARCH_REQUEST and STATISTICS_RESPONSE
+    CorpusStatistics statistics;
+    // SEARCH_RESPONSE
+    std::vector<Document> documents;
+    // INVALID_QUERY_RESPONSE
+    std::string error;
+};
+
+// Appends the framed message to out
+void EncodeShardMessage(const ShardMessage& message, std::string& out);
+
+// Size of the whole frame at the start of data, 0 if the header isn't complete yet.
+// Throws std::runtime_error if the frame is larger than MAX_SHARD_MESSAGE_SIZE
+size_t GetShardFrameSize(std::string_view data);
+
+// Decodes one complete frame. Throws std::runtime_error on a malformed message
+ShardMessage DecodeShardMessage(std::string_view frame);
+
+// Blocking exchange of whole frames over a socket, used by the shard side.
+// ReceiveShardMessage returns false when the peer closed the connection between messages
+bool ReceiveShardMessage(int fd, ShardMessage& message);
+void SendShardMessage(int fd, const ShardMessage& message);
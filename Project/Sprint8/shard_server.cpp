@@ -0,0 +1,155 @@
+#include "shard_protocol.h"
+#include "shard_server.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <execution>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+using namespace std;
+
+sockaddr_un MakeUnixSocketAddress(const string& path) {
+    sockaddr_un address = {};
+    address.sun_family = AF_UNIX;
+    if (path.empty() || path.size() >= sizeof(address.sun_path)) {
+        throw invalid_argument("Invalid Unix socket path "s + path);
+    }
+    memcpy(address.sun_path, path.data(), path.size());
+    return address;
+}
+
+ShardServer::ShardServer(const SearchServer& server, string socket_path)
+    : server_(server), socket_path_(move(socket_path)) {
+    const sockaddr_un address = MakeUnixSocketAddress(socket_path_);
+    if (pipe2(stop_pipe_, O_CLOEXEC) != 0) {
+        throw runtime_error("Can't create pipe: "s + strerror(errno));
+    }
+    listen_fd_ = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    unlink(socket_path_.c_str());
+    if (listen_fd_ < 0 || bind(listen_fd_, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0
+        || listen(listen_fd_, SOMAXCONN) != 0) {
+        const string error = strerror(errno);
+        if (listen_fd_ >= 0) {
+            close(listen_fd_);
+        }
+        close(stop_pipe_[0]);
+        close(stop_pipe_[1]);
+        throw runtime_error("Can't listen on "s + socket_path_ + ": "s + error);
+    }
+}
+
+ShardServer::~ShardServer() {
+    close(listen_fd_);
+    close(stop_pipe_[0]);
+    close(stop_pipe_[1]);
+    unlink(socket_path_.c_str());
+}
+
+void ShardServer::Run() {
+    for (;;) {
+        pollfd fds[2] = {{listen_fd_, POLLIN, 0}, {stop_pipe_[0], POLLIN, 0}};
+        if (poll(fds, 2, -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw runtime_error("Can't wait for connections: "s + strerror(errno));
+        }
+        if (fds[1].revents != 0) {
+            break;
+        }
+        const int fd = accept4(listen_fd_, nullptr, nullptr, SOCK_CLOEXEC);
+        if (fd < 0) {
+            // the client may have given up already
+            continue;
+        }
+        ReapConnectionThreads();
+        lock_guard guard(mutex_);
+        connections_.push_back(fd);
+        const uint64_t connection_id = next_connection_id_++;
+        connection_threads_.emplace(connection_id, thread([this, connection_id, fd] { ServeConnection(connection_id, fd); }));
+    }
+
+    {
+        // wakes up the connection threads blocked in read
+        lock_guard guard(mutex_);
+        for (const int fd : connections_) {
+            shutdown(fd, SHUT_RDWR);
+        }
+    }
+    for (auto& [_, connection_thread] : connection_threads_) {
+        connection_thread.join();
+    }
+    connection_threads_.clear();
+    finished_connections_.clear();
+}
+
+void ShardServer::Stop() {
+    const char byte = 0;
+    // the pipe only has to become readable, a full pipe is as good as a written byte
+    [[maybe_unused]] const ssize_t result = write(stop_pipe_[1], &byte, 1);
+}
+
+const string& ShardServer::GetSocketPath() const {
+    return socket_path_;
+}
+
+void ShardServer::ReapConnectionThreads() {
+    vector<thread> finished;
+    {
+        lock_guard guard(mutex_);
+        for (const uint64_t connection_id : finished_connections_) {
+            const auto it = connection_threads_.find(connection_id);
+            finished.push_back(move(it->second));
+            connection_threads_.erase(it);
+        }
+        finished_connections_.clear();
+    }
+    for (thread& connection_thread : finished) {
+        connection_thread.join();
+    }
+}
+
+void ShardServer::ServeConnection(uint64_t connection_id, int fd) {
+    try {
+        ShardMessage request;
+        while (ReceiveShardMessage(fd, request)) {
+            ShardMessage response;
+            try {
+                switch (request.type) {
+                case ShardMessageType::STATISTICS_REQUEST:
+                    response.type = ShardMessageType::STATISTICS_RESPONSE;
+                    server_.CollectStatistics(request.query, response.statistics);
+                    break;
+                case ShardMessageType::SEARCH_REQUEST:
+                    response.type = ShardMessageType::SEARCH_RESPONSE;
+                    response.documents = server_.FindTopDocuments(execution::seq, request.query,
+                        [status = request.status](int, DocumentStatus document_status, int) {
+                            return document_status == status;
+                        },
+                        request.statistics);
+                    break;
+                default:
+                    throw runtime_error("Unexpected shard request"s);
+                }
+            } catch (const invalid_argument& error) {
+                response = {};
+                response.type = ShardMessageType::INVALID_QUERY_RESPONSE;
+                response.error = error.what();
+            }
+            SendShardMessage(fd, response);
+        }
+    } catch (const exception&) {
+        // a broken connection only ends itself, the coordinator sees it as a shard failure
+    }
+
+    lock_guard guard(mutex_);
+    connections_.erase(find(connections_.begin(), connections_.end(), fd));
+    close(fd);
+    finished_connections_.push_back(connection_id);
+}
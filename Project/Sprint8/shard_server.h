@@ -0,0 +1,59 @@
+#pragma once
+
+#include "search_server.h"
+
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/un.h>
+
+// Serves one SearchServer to SearchCoordinator processes over a Unix domain socket.
+// Each connection gets its own thread and may carry any number of requests.
+// The server must not be modified while the shard is serving
+class ShardServer {
+public:
+    // Creates the socket file, replacing a stale one.
+    // Throws std::invalid_argument if the path is too long, std::runtime_error if listening fails
+    ShardServer(const SearchServer& server, std::string socket_path);
+
+    ShardServer(const ShardServer&) = delete;
+    ShardServer& operator=(const ShardServer&) = delete;
+
+    // Removes the socket file
+    ~ShardServer();
+
+    // Accepts connections until Stop() is called, then closes them and returns
+    void Run();
+
+    // May be called from any thread, also before Run()
+    void Stop();
+
+    const std::string& GetSocketPath() const;
+
+private:
+    void ServeConnection(uint64_t connection_id, int fd);
+
+    // Joins the threads of closed connections
+    void ReapConnectionThreads();
+
+    const SearchServer& server_;
+    std::string socket_path_;
+    int listen_fd_ = -1;
+    // Stop() writes to the pipe to wake up Run()
+    int stop_pipe_[2] = {-1, -1};
+
+    std::mutex mutex_;
+    // Open connections, a connection thread closes its socket under the mutex
+    std::vector<int> connections_;
+    uint64_t next_connection_id_ = 0;
+    std::map<uint64_t, std::thread> connection_threads_;
+    // Connections whose thread is about to return, Run() joins them as it accepts new ones
+    std::vector<uint64_t> finished_connections_;
+};
+
+// Socket address for path. Throws std::invalid_argument if the path doesn't fit
+sockaddr_un MakeUnixSocketAddress(const std::string& path);
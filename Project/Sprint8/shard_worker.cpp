@@ -0,0 +1,67 @@
+#include "shard_worker.h"
+
+using namespace std;
+
+ShardWorker::ShardWorker(const NumaTopology* topology, int node_index)
+    : topology_(topology), node_index_(topology != nullptr ? node_index : -1) {
+    // the thread starts last, when all the members are initialized
+    thread_ = thread([this] { Run(); });
+}
+
+ShardWorker::~ShardWorker() {
+    {
+        lock_guard guard(mutex_);
+        stopping_ = true;
+    }
+    has_tasks_.notify_one();
+    thread_.join();
+}
+
+ShardWorkerStats ShardWorker::GetStats() const {
+    ShardWorkerStats stats;
+    stats.node_index = node_index_;
+    stats.binding.pinned = pinned_;
+    stats.binding.memory_bound = memory_bound_;
+    stats.tasks = tasks_done_;
+    stats.remote_submissions = remote_submissions_;
+    stats.off_node_executions = off_node_executions_;
+    return stats;
+}
+
+void ShardWorker::Push(function<void()> task) {
+    if (node_index_ >= 0 && topology_->GetCurrentNodeIndex() != node_index_) {
+        ++remote_submissions_;
+    }
+    {
+        lock_guard guard(mutex_);
+        tasks_.push_back(move(task));
+    }
+    has_tasks_.notify_one();
+}
+
+void ShardWorker::Run() {
+    // binding comes before any task, so everything the tasks allocate is placed on the node
+    if (node_index_ >= 0) {
+        const NodeBinding binding = BindCurrentThreadToNode(topology_->GetNodes()[node_index_]);
+        pinned_ = binding.pinned;
+        memory_bound_ = binding.memory_bound;
+    }
+
+    for (;;) {
+        function<void()> task;
+        {
+            unique_lock lock(mutex_);
+            has_tasks_.wait(lock, [this] { return stopping_ || !tasks_.empty(); });
+            if (tasks_.empty()) {
+                return;
+            }
+            task = move(tasks_.front());
+            tasks_.pop_front();
+        }
+        if (node_index_ >= 0 && topology_->GetCurrentNodeIndex() != node_index_) {
+            ++off_node_executions_;
+        }
+        ++tasks_done_;
+        task();
+    }
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include "numa_topology.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+
+struct ShardWorkerStats {
+    // Index in NumaTopology::GetNodes(), -1 for a worker without placement
+    int node_index = -1;
+    NodeBinding binding;
+    size_t tasks = 0;
+    // Tasks submitted from a CPU of another node, their arguments and results cross the interconnect
+    size_t remote_submissions = 0;
+    // Tasks that ran on a CPU of another node, e.g. because pinning failed
+    size_t off_node_executions = 0;
+};
+
+// A thread that owns one shard: every task for the shard runs on it, in submission order,
+// so the shard's data is only ever touched by a single thread.
+// A worker placed on a NUMA node runs on the node's CPUs and allocates from its memory,
+// so data created by its tasks is local to the CPUs that scan it
+class ShardWorker {
+public:
+    // topology must outlive the worker, without it the worker isn't placed anywhere
+    explicit ShardWorker(const NumaTopology* topology = nullptr, int node_index = -1);
+
+    ShardWorker(const ShardWorker&) = delete;
+    ShardWorker& operator=(const ShardWorker&) = delete;
+
+    // Runs the queued tasks and stops the thread
+    ~ShardWorker();
+
+    // Queues the task, the future receives its result or exception
+    template <typename Function>
+    std::future<std::invoke_result_t<Function>> Submit(Function function);
+
+    ShardWorkerStats GetStats() const;
+
+private:
+    void Run();
+
+    void Push(std::function<void()> task);
+
+    const NumaTopology* topology_ = nullptr;
+    int node_index_ = -1;
+    std::atomic<bool> pinned_ = false;
+    std::atomic<bool> memory_bound_ = false;
+    std::atomic<size_t> tasks_done_ = 0;
+    std::atomic<size_t> remote_submissions_ = 0;
+    std::atomic<size_t> off_node_executions_ = 0;
+
+    std::mutex mutex_;
+    std::condition_variable has_tasks_;
+    std::deque<std::function<void()>> tasks_;
+    bool stopping_ = false;
+    std::thread thread_;
+};
+
+template <typename Function>
+std::future<std::invoke_result_t<Function>> ShardWorker::Submit(Function function) {
+    // std::function needs a copyable target, the task itself is move-only
+    auto task = std::make_shared<std::packaged_task<std::invoke_result_t<Function>()>>(std::move(function));
+    auto result = task->get_future();
+    Push([task] { (*task)(); });
+    return result;
+}
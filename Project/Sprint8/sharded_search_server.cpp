@@ -0,0 +1,139 @@
+#include "sharded_search_server.h"
+
+#include <stdexcept>
+
+using namespace std;
+
+ShardedSearchServer::ShardedSearchServer(const string& stop_words_text, size_t shard_count, SearchServerOptions options)
+    : ShardedSearchServer(stop_words_text, shard_count, options, NumaTopology::Detect()) {
+}
+
+ShardedSearchServer::ShardedSearchServer(const string& stop_words_text, size_t shard_count, SearchServerOptions options,
+    NumaTopology topology)
+    : topology_(move(topology)) {
+    if (shard_count == 0) {
+        throw invalid_argument("Shard count must be positive"s);
+    }
+
+    shards_.resize(shard_count);
+    const int node_count = static_cast<int>(topology_.GetNodes().size());
+    vector<future<void>> futures;
+    for (size_t i = 0; i < shard_count; ++i) {
+        workers_.push_back(make_unique<ShardWorker>(&topology_, static_cast<int>(i) % node_count));
+        // first touch from the bound worker puts the shard on its node
+        futures.push_back(workers_[i]->Submit([this, i, &stop_words_text, options] {
+            shards_[i] = make_unique<SearchServer>(stop_words_text, options);
+        }));
+    }
+    for (auto& future : futures) {
+        future.wait();
+    }
+    for (auto& future : futures) {
+        future.get();
+    }
+}
+
+size_t ShardedSearchServer::GetShardCount() const {
+    return shards_.size();
+}
+
+const NumaTopology& ShardedSearchServer::GetTopology() const {
+    return topology_;
+}
+
+vector<ShardWorkerStats> ShardedSearchServer::GetPlacementStats() const {
+    vector<ShardWorkerStats> stats;
+    for (const auto& worker : workers_) {
+        stats.push_back(worker->GetStats());
+    }
+    return stats;
+}
+
+int ShardedSearchServer::GetDocumentCount() const {
+    vector<future<int>> futures;
+    for (size_t i = 0; i < shards_.size(); ++i) {
+        futures.push_back(workers_[i]->Submit([this, i] { return shards_[i]->GetDocumentCount(); }));
+    }
+
+    int document_count = 0;
+    for (const int shard_document_count : Gather(futures)) {
+        document_count += shard_document_count;
+    }
+    return document_count;
+}
+
+void ShardedSearchServer::AddDocument(int document_id, const string_view document, DocumentStatus status, const vector<int>& ratings) {
+    const size_t shard = GetShardIndex(document_id);
+    workers_[shard]->Submit([this, shard, document_id, document, status, &ratings] {
+        shards_[shard]->AddDocument(document_id, document, status, ratings);
+    }).get();
+}
+
+void ShardedSearchServer::RemoveDocument(int document_id) {
+    const size_t shard = GetShardIndex(document_id);
+    workers_[shard]->Submit([this, shard, document_id] {
+        shards_[shard]->RemoveDocument(document_id);
+    }).get();
+}
+
+vector<Document> ShardedSearchServer::FindTopDocuments(const string_view raw_query, DocumentStatus input_status) const {
+    return FindTopDocuments(raw_query,
+        [input_status](int, DocumentStatus status, int) {
+            return status == input_status;
+        });
+}
+
+tuple<vector<string_view>, DocumentStatus> ShardedSearchServer::MatchDocument(const string_view raw_query, int document_id) const {
+    const size_t shard = GetShardIndex(document_id);
+    return workers_[shard]->Submit([this, shard, raw_query, document_id] {
+        return shards_[shard]->MatchDocument(raw_query, document_id);
+    }).get();
+}
+
+// Fibonacci hashing spreads runs of consecutive ids evenly
+size_t ShardedSearchServer::GetShardIndex(int document_id) const {
+    const uint64_t hash = static_cast<uint64_t>(static_cast<uint32_t>(document_id)) * 0x9e3779b97f4a7c15ull;
+    return static_cast<size_t>((hash >> 32) % shards_.size());
+}
+
+CorpusStatistics ShardedSearchServer::CollectStatistics(const string_view raw_query) const {
+    vector<future<CorpusStatistics>> futures;
+    for (size_t i = 0; i < shards_.size(); ++i) {
+        futures.push_back(workers_[i]->Submit([this, i, raw_query] {
+            CorpusStatistics statistics;
+            shards_[i]->CollectStatistics(raw_query, statistics);
+            return statistics;
+        }));
+    }
+
+    CorpusStatistics total;
+    for (const CorpusStatistics& statistics : Gather(futures)) {
+        total.document_count += statistics.document_count;
+        for (const auto& [word, document_freq] : statistics.document_freqs) {
+            total.document_freqs[word] += document_freq;
+        }
+    }
+    return total;
+}
+
+vector<Document> ShardedSearchServer::MergeTopDocuments(const vector<vector<Document>>& shard_results) {
+    vector<Document> merged;
+    vector<size_t> positions(shard_results.size());
+    while (merged.size() < MAX_RESULT_DOCUMENT_COUNT) {
+        size_t best_shard = shard_results.size();
+        for (size_t shard = 0; shard < shard_results.size(); ++shard) {
+            if (positions[shard] == shard_results[shard].size()) {
+                continue;
+            }
+            if (best_shard == shard_results.size()
+                || SearchServer::IsMoreRelevant(shard_results[shard][positions[shard]], shard_results[best_shard][positions[best_shard]])) {
+                best_shard = shard;
+            }
+        }
+        if (best_shard == shard_results.size()) {
+            break;
+        }
+        merged.push_back(shard_results[best_shard][positions[best_shard]++]);
+    }
+    return merged;
+}
@@ -0,0 +1,101 @@
+#pragma once
+
+#include "document.h"
+#include "numa_topology.h"
+#include "search_server.h"
+#include "shard_worker.h"
+
+#include <execution>
+#include <future>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <vector>
+
+// Documents hash-partitioned over independent SearchServer shards. Each shard is owned by its own
+// worker thread, requests are sent to the owners and queries are scatter-gathered.
+// Shards are spread round-robin over the NUMA nodes: a shard's worker runs on its node's CPUs
+// and the shard is created and filled by that worker, so its postings live in the node's memory.
+// IDF is computed from the document counts of all shards, so relevance is exactly the one
+// of a single server with the same documents. Duplicate policies apply within a shard.
+// All the methods may be called from several threads
+class ShardedSearchServer {
+public:
+    // Places the shards on the nodes detected in sysfs
+    ShardedSearchServer(const std::string& stop_words_text, size_t shard_count, SearchServerOptions options = {});
+
+    ShardedSearchServer(const std::string& stop_words_text, size_t shard_count, SearchServerOptions options,
+        NumaTopology topology);
+
+    // The workers refer to the topology
+    ShardedSearchServer(const ShardedSearchServer&) = delete;
+    ShardedSearchServer& operator=(const ShardedSearchServer&) = delete;
+
+    const NumaTopology& GetTopology() const;
+
+    // Placement of every shard and the tasks that crossed node boundaries
+    std::vector<ShardWorkerStats> GetPlacementStats() const;
+
+    size_t GetShardCount() const;
+
+    int GetDocumentCount() const;
+
+    void AddDocument(int document_id, const std::string_view document, DocumentStatus status, const std::vector<int>& ratings);
+
+    void RemoveDocument(int document_id);
+
+    std::vector<Document> FindTopDocuments(const std::string_view raw_query, DocumentStatus input_status = DocumentStatus::ACTUAL) const;
+
+    // comp is called on the shard threads
+    template <typename Comparator>
+    std::vector<Document> FindTopDocuments(const std::string_view raw_query, Comparator comp) const;
+
+    // The words point into the dictionary of the shard that holds the document
+    std::tuple<std::vector<std::string_view>, DocumentStatus> MatchDocument(const std::string_view raw_query, int document_id) const;
+
+    // k-way merge of per-shard top lists, each sorted by SearchServer::IsMoreRelevant
+    static std::vector<Document> MergeTopDocuments(const std::vector<std::vector<Document>>& shard_results);
+
+private:
+    size_t GetShardIndex(int document_id) const;
+
+    // Totals over all the shards for the plus words of the query
+    CorpusStatistics CollectStatistics(const std::string_view raw_query) const;
+
+    // Waits for every future before taking the results, so no task outlives the data it refers to
+    template <typename T>
+    static std::vector<T> Gather(std::vector<std::future<T>>& futures);
+
+    NumaTopology topology_;
+    // Each shard is allocated by its worker
+    std::vector<std::unique_ptr<SearchServer>> shards_;
+    // Declared after the shards so the workers stop before the shards are destroyed
+    std::vector<std::unique_ptr<ShardWorker>> workers_;
+};
+
+template <typename Comparator>
+std::vector<Document> ShardedSearchServer::FindTopDocuments(const std::string_view raw_query, Comparator comp) const {
+    const CorpusStatistics statistics = CollectStatistics(raw_query);
+
+    std::vector<std::future<std::vector<Document>>> futures;
+    for (size_t i = 0; i < shards_.size(); ++i) {
+        futures.push_back(workers_[i]->Submit([this, i, raw_query, comp, &statistics] {
+            return shards_[i]->FindTopDocuments(std::execution::seq, raw_query, comp, statistics);
+        }));
+    }
+    return MergeTopDocuments(Gather(futures));
+}
+
+template <typename T>
+std::vector<T> ShardedSearchServer::Gather(std::vector<std::future<T>>& futures) {
+    for (auto& future : futures) {
+        future.wait();
+    }
+    std::vector<T> results;
+    results.reserve(futures.size());
+    for (auto& future : futures) {
+        results.push_back(future.get());
+    }
+    return results;
+}
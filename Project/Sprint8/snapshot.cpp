@@ -0,0 +1,482 @@
+#include "block_io.h"
+#include "checksum.h"
+#include "mapped_file.h"
+#include "search_server.h"
+#include "snapshot.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <exception>
+#include <execution>
+#include <functional>
+#include <numeric>
+#include <stdexcept>
+#include <thread>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+using namespace std;
+
+namespace {
+
+size_t AlignToPage(size_t size) {
+    return (size + SNAPSHOT_PAGE_SIZE - 1) / SNAPSHOT_PAGE_SIZE * SNAPSHOT_PAGE_SIZE;
+}
+
+size_t GetChunkCount() {
+    return clamp<size_t>(thread::hardware_concurrency(), 1, SNAPSHOT_MAX_CHUNKS);
+}
+
+// Exceptions must not escape a parallel algorithm, the first one is rethrown after all tasks finish
+template <typename Function>
+void RunInParallel(size_t count, Function function) {
+    vector<size_t> indexes(count);
+    iota(indexes.begin(), indexes.end(), 0);
+    vector<exception_ptr> errors(count);
+    for_each(execution::par, indexes.begin(), indexes.end(), [&function, &errors](size_t i) {
+        try {
+            function(i);
+        } catch (...) {
+            errors[i] = current_exception();
+        }
+    });
+    for (const exception_ptr& error : errors) {
+        if (error) {
+            rethrow_exception(error);
+        }
+    }
+}
+
+template <typename Record>
+void AppendRecords(string& section, const vector<Record>& records) {
+    section.append(reinterpret_cast<const char*>(records.data()), records.size() * sizeof(Record));
+}
+
+template <typename Record>
+void AppendRecord(string& section, const Record& record) {
+    section.append(reinterpret_cast<const char*>(&record), sizeof(Record));
+}
+
+// Sequential bounds-checked access to the records of one section
+class SectionReader {
+public:
+    SectionReader(const MappedFile& file, const SnapshotSectionInfo& info)
+        : data_(file.data() + info.offset, info.size) {
+    }
+
+    template <typename Record>
+    span<const Record> Take(size_t count) {
+        if (count > data_.size() / sizeof(Record)) {
+            throw runtime_error("Snapshot section is damaged"s);
+        }
+        // sections are page aligned and all records are multiples of 8 bytes
+        const span<const Record> records(reinterpret_cast<const Record*>(data_.data()), count);
+        data_.remove_prefix(count * sizeof(Record));
+        return records;
+    }
+
+    template <typename Record>
+    const Record& TakeOne() {
+        return Take<Record>(1)[0];
+    }
+
+    template <typename Record>
+    span<const Record> TakeRest() {
+        if (data_.size() % sizeof(Record) != 0) {
+            throw runtime_error("Snapshot section has invalid size"s);
+        }
+        return Take<Record>(data_.size() / sizeof(Record));
+    }
+
+    string_view TakeString(size_t size) {
+        if (size > data_.size()) {
+            throw runtime_error("Snapshot section is damaged"s);
+        }
+        const string_view result = data_.substr(0, size);
+        data_.remove_prefix(size);
+        return result;
+    }
+
+private:
+    string_view data_;
+};
+
+string_view GetWord(string_view strings, const SnapshotWordRecord& record) {
+    if (record.string_offset > strings.size() || record.length > strings.size() - record.string_offset) {
+        throw runtime_error("Snapshot string is out of bounds"s);
+    }
+    return strings.substr(record.string_offset, record.length);
+}
+
+// Checks the header and the bounds of every section, section checksums are verified in parallel
+SnapshotHeader ReadHeader(const MappedFile& file) {
+    if (file.size() < sizeof(SnapshotHeader)) {
+        throw runtime_error("Snapshot is truncated"s);
+    }
+
+    SnapshotHeader header;
+    memcpy(&header, file.data(), sizeof(header));
+    if (header.magic != SNAPSHOT_MAGIC) {
+        throw runtime_error("Not a snapshot file"s);
+    }
+    if (header.version != SNAPSHOT_VERSION) {
+        throw runtime_error("Unsupported snapshot version "s + to_string(header.version));
+    }
+    if (header.checksum != ComputeChecksum(file.data(), offsetof(SnapshotHeader, checksum)) || header.section_count > SNAPSHOT_MAX_SECTIONS) {
+        throw runtime_error("Snapshot header is damaged"s);
+    }
+    if (header.file_size != file.size()) {
+        throw runtime_error("Snapshot is truncated"s);
+    }
+
+    const span<const SnapshotSectionInfo> sections(header.sections, header.section_count);
+    for (const SnapshotSectionInfo& info : sections) {
+        if (info.offset % SNAPSHOT_PAGE_SIZE != 0 || info.offset > file.size() || info.size > file.size() - info.offset) {
+            throw runtime_error("Snapshot section is out of bounds"s);
+        }
+    }
+    const bool intact = all_of(execution::par, sections.begin(), sections.end(), [&file](const SnapshotSectionInfo& info) {
+        return info.checksum == ComputeChecksum(file.data() + info.offset, info.size);
+    });
+    if (!intact) {
+        throw runtime_error("Snapshot checksum mismatch"s);
+    }
+    return header;
+}
+
+vector<SnapshotSectionInfo> GetSections(const SnapshotHeader& header, SnapshotSection type) {
+    vector<SnapshotSectionInfo> result;
+    copy_if(header.sections, header.sections + header.section_count, back_inserter(result),
+        [type](const SnapshotSectionInfo& info) { return info.type == type; });
+    return result;
+}
+
+SnapshotSectionInfo GetSingleSection(const SnapshotHeader& header, SnapshotSection type) {
+    const auto sections = GetSections(header, type);
+    if (sections.size() != 1) {
+        throw runtime_error("Snapshot must have exactly one section of type "s + to_string(static_cast<uint32_t>(type)));
+    }
+    return sections[0];
+}
+
+const SnapshotMetaRecord& GetMeta(const MappedFile& file, const SnapshotHeader& header) {
+    SectionReader reader(file, GetSingleSection(header, SnapshotSection::META));
+    const auto& meta = reader.TakeOne<SnapshotMetaRecord>();
+    if (meta.duplicate_policy > static_cast<uint8_t>(DuplicatePolicy::ALIAS)) {
+        throw runtime_error("Snapshot options are damaged"s);
+    }
+    return meta;
+}
+
+}  // namespace
+
+SnapshotInfo ReadSnapshotInfo(const string& path) {
+    const MappedFile file(path);
+    const SnapshotHeader header = ReadHeader(file);
+
+    SnapshotInfo info;
+    info.log_sequence_number = GetMeta(file, header).log_sequence_number;
+    for (const auto& section : GetSections(header, SnapshotSection::DOCUMENTS)) {
+        SectionReader reader(file, section);
+        info.document_count += reader.TakeOne<SnapshotDocumentChunkHeader>().document_count;
+    }
+    return info;
+}
+
+void SearchServer::SaveSnapshot(const string& path, uint64_t log_sequence_number) const {
+    const size_t chunk_count = GetChunkCount();
+
+    // term chunks hold roughly equal numbers of postings
+    vector<decltype(words_)::const_iterator> term_bounds = {words_.begin()};
+    size_t total_postings = 0;
+    for (const auto& [word, document_freqs] : word_to_document_freqs_) {
+        total_postings += document_freqs.size() + 1;
+    }
+    size_t chunk_postings = 0;
+    for (auto it = words_.begin(); it != words_.end(); ++it) {
+        chunk_postings += word_to_document_freqs_.at(it->first).size() + 1;
+        if (chunk_postings * chunk_count >= total_postings * term_bounds.size() && term_bounds.size() < chunk_count) {
+            term_bounds.push_back(next(it));
+        }
+    }
+    term_bounds.push_back(words_.end());
+
+    // document chunks hold equal numbers of documents
+    vector<decltype(documents_)::const_iterator> document_bounds = {documents_.begin()};
+    size_t document_index = 0;
+    for (auto it = documents_.begin(); it != documents_.end(); ++it) {
+        if (++document_index * chunk_count >= documents_.size() * document_bounds.size() && document_bounds.size() < chunk_count) {
+            document_bounds.push_back(next(it));
+        }
+    }
+    document_bounds.push_back(documents_.end());
+
+    vector<pair<SnapshotSection, string>> sections;
+    vector<function<void(string&)>> builders;
+
+    builders.push_back([this, log_sequence_number](string& data) {
+        SnapshotMetaRecord meta;
+        meta.use_forward_index = options_.use_forward_index;
+        meta.duplicate_policy = static_cast<uint8_t>(options_.duplicate_policy);
+        meta.word_id_count = static_cast<uint32_t>(id_to_word_.size());
+        meta.reclaimed_bytes = reclaimed_bytes_;
+        meta.log_sequence_number = log_sequence_number;
+        AppendRecord(data, meta);
+    });
+    sections.emplace_back(SnapshotSection::META, string());
+
+    builders.push_back([this](string& data) {
+        vector<SnapshotWordRecord> records;
+        string strings;
+        for (const string& word : stop_words_) {
+            records.push_back({strings.size(), 0, static_cast<uint32_t>(word.size()), 0, 0, 0});
+            strings += word;
+        }
+        AppendRecord(data, SnapshotTermChunkHeader{records.size(), 0, strings.size()});
+        AppendRecords(data, records);
+        data += strings;
+    });
+    sections.emplace_back(SnapshotSection::STOP_WORDS, string());
+
+    for (size_t chunk = 0; chunk + 1 < term_bounds.size(); ++chunk) {
+        builders.push_back([this, first = term_bounds[chunk], last = term_bounds[chunk + 1]](string& data) {
+            vector<SnapshotWordRecord> records;
+            vector<SnapshotPostingRecord> postings;
+            string strings;
+            for (auto it = first; it != last; ++it) {
+                const auto& document_freqs = word_to_document_freqs_.at(it->first);
+                records.push_back({strings.size(), postings.size(), static_cast<uint32_t>(it->first.size()), it->second,
+                    static_cast<uint32_t>(document_freqs.size()), 0});
+                strings += it->first;
+                for (const auto& [document_id, term_freq] : document_freqs) {
+                    postings.push_back({document_id, 0, term_freq});
+                }
+            }
+            AppendRecord(data, SnapshotTermChunkHeader{records.size(), postings.size(), strings.size()});
+            AppendRecords(data, records);
+            AppendRecords(data, postings);
+            data += strings;
+        });
+        sections.emplace_back(SnapshotSection::TERMS, string());
+    }
+
+    for (size_t chunk = 0; chunk + 1 < document_bounds.size(); ++chunk) {
+        builders.push_back([this, first = document_bounds[chunk], last = document_bounds[chunk + 1]](string& data) {
+            vector<SnapshotDocumentRecord> documents;
+            vector<SnapshotForwardRangeRecord> forward_ranges;
+            vector<ForwardIndex::Entry> forward_entries;
+            for (auto it = first; it != last; ++it) {
+                const auto& [document_id, document_data] = *it;
+                documents.push_back({document_id, document_data.rating, static_cast<int32_t>(document_data.status), 0,
+                    document_data.signature.low, document_data.signature.high});
+
+                if (options_.use_forward_index) {
+                    const auto entries = document_to_word_freqs_.Get(document_id);
+                    forward_ranges.push_back({forward_entries.size(), document_id, static_cast<uint32_t>(entries.size())});
+                    forward_entries.insert(forward_entries.end(), entries.begin(), entries.end());
+                }
+            }
+            AppendRecord(data, SnapshotDocumentChunkHeader{documents.size(), forward_ranges.size(), forward_entries.size()});
+            AppendRecords(data, documents);
+            AppendRecords(data, forward_ranges);
+            AppendRecords(data, forward_entries);
+        });
+        sections.emplace_back(SnapshotSection::DOCUMENTS, string());
+    }
+
+    builders.push_back([this](string& data) {
+        vector<SnapshotAliasRecord> aliases;
+        for (const auto& [alias_id, document_id] : alias_to_document_) {
+            aliases.push_back({alias_id, document_id});
+        }
+        AppendRecords(data, aliases);
+    });
+    sections.emplace_back(SnapshotSection::ALIASES, string());
+
+    // every section is serialized and checksummed independently
+    SnapshotHeader header;
+    header.section_count = static_cast<uint32_t>(sections.size());
+    RunInParallel(sections.size(), [&](size_t i) {
+        string& data = sections[i].second;
+        builders[i](data);
+        header.sections[i].type = sections[i].first;
+        header.sections[i].size = data.size();
+        header.sections[i].checksum = ComputeChecksum(data.data(), data.size());
+    });
+
+    size_t offset = SNAPSHOT_PAGE_SIZE;
+    vector<WriteRequest> requests = {{reinterpret_cast<const char*>(&header), sizeof(header), 0}};
+    for (size_t i = 0; i < sections.size(); ++i) {
+        header.sections[i].offset = offset;
+        requests.push_back({sections[i].second.data(), sections[i].second.size(), offset});
+        offset += AlignToPage(sections[i].second.size());
+    }
+    header.file_size = offset;
+    header.checksum = ComputeChecksum(reinterpret_cast<const char*>(&header), offsetof(SnapshotHeader, checksum));
+
+    // the snapshot replaces the old file only when it is completely written,
+    // the gaps between sections are zero-filled by the preallocation
+    const string temp_path = path + ".tmp"s;
+    const int fd = open(temp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        throw runtime_error("Can't create snapshot "s + temp_path + ": "s + strerror(errno));
+    }
+    try {
+        if (ftruncate(fd, static_cast<off_t>(header.file_size)) != 0) {
+            throw runtime_error("Can't allocate snapshot "s + temp_path + ": "s + strerror(errno));
+        }
+        WriteBlocks(fd, requests);
+        if (fdatasync(fd) != 0) {
+            throw runtime_error("Can't sync snapshot "s + temp_path + ": "s + strerror(errno));
+        }
+    } catch (...) {
+        close(fd);
+        throw;
+    }
+    close(fd);
+
+    if (rename(temp_path.c_str(), path.c_str()) != 0) {
+        throw runtime_error("Can't replace snapshot "s + path);
+    }
+}
+
+SearchServer SearchServer::LoadSnapshot(const string& path) {
+    const MappedFile file(path);
+    const SnapshotHeader header = ReadHeader(file);
+    const SnapshotMetaRecord& meta = GetMeta(file, header);
+
+    vector<string_view> stop_words;
+    {
+        SectionReader reader(file, GetSingleSection(header, SnapshotSection::STOP_WORDS));
+        const auto& chunk_header = reader.TakeOne<SnapshotTermChunkHeader>();
+        const auto records = reader.Take<SnapshotWordRecord>(chunk_header.word_count);
+        const string_view strings = reader.TakeString(chunk_header.string_size);
+        for (const auto& record : records) {
+            stop_words.push_back(GetWord(strings, record));
+        }
+    }
+
+    SearchServerOptions options;
+    options.use_forward_index = meta.use_forward_index != 0;
+    options.duplicate_policy = static_cast<DuplicatePolicy>(meta.duplicate_policy);
+    SearchServer server(stop_words, options);
+    server.reclaimed_bytes_ = meta.reclaimed_bytes;
+
+    // term chunks are decoded in parallel into separate containers
+    struct TermChunk {
+        vector<string> words;
+        vector<uint32_t> word_ids;
+        vector<map<int, double>> postings;
+    };
+    const auto term_sections = GetSections(header, SnapshotSection::TERMS);
+    vector<TermChunk> term_chunks(term_sections.size());
+    RunInParallel(term_sections.size(), [&](size_t i) {
+        SectionReader reader(file, term_sections[i]);
+        const auto& chunk_header = reader.TakeOne<SnapshotTermChunkHeader>();
+        const auto records = reader.Take<SnapshotWordRecord>(chunk_header.word_count);
+        const auto postings = reader.Take<SnapshotPostingRecord>(chunk_header.posting_count);
+        const string_view strings = reader.TakeString(chunk_header.string_size);
+
+        TermChunk& chunk = term_chunks[i];
+        for (const auto& record : records) {
+            if (record.posting_offset > postings.size() || record.posting_count > postings.size() - record.posting_offset) {
+                throw runtime_error("Snapshot posting list is damaged"s);
+            }
+            chunk.words.emplace_back(GetWord(strings, record));
+            chunk.word_ids.push_back(record.word_id);
+
+            auto& document_freqs = chunk.postings.emplace_back();
+            for (const auto& posting : postings.subspan(record.posting_offset, record.posting_count)) {
+                document_freqs.emplace_hint(document_freqs.end(), posting.document_id, posting.term_freq);
+            }
+        }
+    });
+
+    // chunks hold consecutive word ranges, so every insertion goes to the end of the maps
+    server.id_to_word_.resize(meta.word_id_count);
+    server.word_storage_.resize(meta.word_id_count);
+    vector<bool> used_ids(meta.word_id_count);
+    for (TermChunk& chunk : term_chunks) {
+        for (size_t i = 0; i < chunk.word_ids.size(); ++i) {
+            const uint32_t word_id = chunk.word_ids[i];
+            if (word_id >= meta.word_id_count || used_ids[word_id]) {
+                throw runtime_error("Snapshot word id is damaged"s);
+            }
+            used_ids[word_id] = true;
+
+            const string_view word = server.word_storage_[word_id] = move(chunk.words[i]);
+            if (!server.words_.empty() && prev(server.words_.end())->first >= word) {
+                throw runtime_error("Snapshot words are not sorted"s);
+            }
+            server.words_.emplace_hint(server.words_.end(), word, word_id);
+            server.id_to_word_[word_id] = word;
+            server.word_to_document_freqs_.emplace_hint(server.word_to_document_freqs_.end(), word, move(chunk.postings[i]));
+        }
+    }
+    for (uint32_t word_id = meta.word_id_count; word_id > 0; --word_id) {
+        if (!used_ids[word_id - 1]) {
+            server.free_word_ids_.push_back(word_id - 1);
+        }
+    }
+
+    struct DocumentChunk {
+        span<const SnapshotDocumentRecord> documents;
+        span<const SnapshotForwardRangeRecord> forward_ranges;
+        span<const ForwardIndex::Entry> forward_entries;
+    };
+    const auto document_sections = GetSections(header, SnapshotSection::DOCUMENTS);
+    vector<DocumentChunk> document_chunks(document_sections.size());
+    RunInParallel(document_sections.size(), [&](size_t i) {
+        SectionReader reader(file, document_sections[i]);
+        const auto& chunk_header = reader.TakeOne<SnapshotDocumentChunkHeader>();
+        DocumentChunk& chunk = document_chunks[i];
+        chunk.documents = reader.Take<SnapshotDocumentRecord>(chunk_header.document_count);
+        chunk.forward_ranges = reader.Take<SnapshotForwardRangeRecord>(chunk_header.forward_range_count);
+        chunk.forward_entries = reader.Take<ForwardIndex::Entry>(chunk_header.forward_entry_count);
+        for (const auto& record : chunk.documents) {
+            if (record.status < 0 || record.status > static_cast<int32_t>(DocumentStatus::REMOVED)) {
+                throw runtime_error("Snapshot document is damaged"s);
+            }
+        }
+        for (const auto& record : chunk.forward_ranges) {
+            if (record.offset > chunk.forward_entries.size() || record.count > chunk.forward_entries.size() - record.offset) {
+                throw runtime_error("Snapshot forward index is damaged"s);
+            }
+            // entries refer to dictionary words, sorted by word id
+            const auto entries = chunk.forward_entries.subspan(record.offset, record.count);
+            for (size_t j = 0; j < entries.size(); ++j) {
+                const uint32_t word_id = entries[j].word_id;
+                if (word_id >= meta.word_id_count || !used_ids[word_id] || (j > 0 && entries[j - 1].word_id >= word_id)) {
+                    throw runtime_error("Snapshot forward index is damaged"s);
+                }
+            }
+        }
+    });
+
+    // documents are stored in id order, so every insertion goes to the end of the maps
+    for (const DocumentChunk& chunk : document_chunks) {
+        for (const auto& record : chunk.documents) {
+            const DocumentSignature signature{record.signature_low, record.signature_high};
+            server.documents_.emplace_hint(server.documents_.end(), record.document_id,
+                DocumentData{record.rating, static_cast<DocumentStatus>(record.status), signature});
+            server.document_ids_.emplace_hint(server.document_ids_.end(), record.document_id);
+            if (options.duplicate_policy != DuplicatePolicy::ALLOW) {
+                server.signature_to_documents_[signature].push_back(record.document_id);
+            }
+        }
+        for (const auto& record : chunk.forward_ranges) {
+            const auto entries = chunk.forward_entries.subspan(record.offset, record.count);
+            server.document_to_word_freqs_.Add(record.document_id, {entries.begin(), entries.end()});
+        }
+    }
+
+    SectionReader alias_reader(file, GetSingleSection(header, SnapshotSection::ALIASES));
+    for (const auto& record : alias_reader.TakeRest<SnapshotAliasRecord>()) {
+        server.alias_to_document_.emplace(record.alias_id, record.document_id);
+        server.document_to_aliases_[record.document_id].push_back(record.alias_id);
+    }
+    return server;
+}
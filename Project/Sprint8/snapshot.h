@@ -0,0 +1,121 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Binary snapshot layout of a SearchServer. Integers are stored in host byte order.
+// The header occupies the first page, every section starts on a page boundary,
+// so each section can be used in place from a memory mapping of the file.
+// Words are split into several TERMS sections by word range and documents into several
+// DOCUMENTS sections by id range, so that sections are written and read in parallel
+
+const uint64_t SNAPSHOT_MAGIC = 0x50414e5348435253ull;  // "SRCHSNAP"
+const uint32_t SNAPSHOT_VERSION = 3;
+const size_t SNAPSHOT_PAGE_SIZE = 4096;
+const size_t SNAPSHOT_MAX_SECTIONS = 96;
+const size_t SNAPSHOT_MAX_CHUNKS = 32;
+
+enum class SnapshotSection : uint32_t {
+    // SnapshotMetaRecord
+    META,
+    // SnapshotTermChunkHeader, SnapshotWordRecord array, string data
+    STOP_WORDS,
+    // SnapshotTermChunkHeader, SnapshotWordRecord array, SnapshotPostingRecord array, string data
+    TERMS,
+    // SnapshotDocumentChunkHeader, SnapshotDocumentRecord array,
+    // SnapshotForwardRangeRecord array, ForwardIndex::Entry array
+    DOCUMENTS,
+    // SnapshotAliasRecord array
+    ALIASES,
+};
+
+struct SnapshotSectionInfo {
+    SnapshotSection type = SnapshotSection::META;
+    uint32_t reserved = 0;
+    uint64_t offset = 0;
+    uint64_t size = 0;
+    uint64_t checksum = 0;
+};
+
+struct SnapshotHeader {
+    uint64_t magic = SNAPSHOT_MAGIC;
+    uint32_t version = SNAPSHOT_VERSION;
+    uint32_t section_count = 0;
+    uint64_t file_size = 0;
+    SnapshotSectionInfo sections[SNAPSHOT_MAX_SECTIONS];
+    // checksum of all the header bytes before this field
+    uint64_t checksum = 0;
+};
+
+static_assert(sizeof(SnapshotHeader) <= SNAPSHOT_PAGE_SIZE);
+static_assert(2 * SNAPSHOT_MAX_CHUNKS + 3 <= SNAPSHOT_MAX_SECTIONS);
+
+struct SnapshotMetaRecord {
+    uint8_t use_forward_index = 1;
+    uint8_t duplicate_policy = 0;
+    uint16_t reserved = 0;
+    // size of the word id space, ids missing in TERMS are free
+    uint32_t word_id_count = 0;
+    uint64_t reclaimed_bytes = 0;
+    // last write-ahead log record included in the snapshot
+    uint64_t log_sequence_number = 0;
+};
+
+struct SnapshotTermChunkHeader {
+    uint64_t word_count = 0;
+    uint64_t posting_count = 0;
+    uint64_t string_size = 0;
+};
+
+// string_offset points into the string data of the section, posting_offset into its postings
+struct SnapshotWordRecord {
+    uint64_t string_offset = 0;
+    uint64_t posting_offset = 0;
+    uint32_t length = 0;
+    uint32_t word_id = 0;
+    uint32_t posting_count = 0;
+    uint32_t reserved = 0;
+};
+
+struct SnapshotPostingRecord {
+    int32_t document_id = 0;
+    uint32_t reserved = 0;
+    double term_freq = 0.0;
+};
+
+struct SnapshotDocumentChunkHeader {
+    uint64_t document_count = 0;
+    uint64_t forward_range_count = 0;
+    uint64_t forward_entry_count = 0;
+};
+
+struct SnapshotDocumentRecord {
+    int32_t document_id = 0;
+    int32_t rating = 0;
+    int32_t status = 0;
+    uint32_t reserved = 0;
+    uint64_t signature_low = 0;
+    uint64_t signature_high = 0;
+};
+
+// offset is an index into the forward entries of the section
+struct SnapshotForwardRangeRecord {
+    uint64_t offset = 0;
+    int32_t document_id = 0;
+    uint32_t count = 0;
+};
+
+struct SnapshotAliasRecord {
+    int32_t alias_id = 0;
+    int32_t document_id = 0;
+};
+
+struct SnapshotInfo {
+    uint64_t log_sequence_number = 0;
+    size_t document_count = 0;
+};
+
+// Validates the snapshot and reads its summary without loading the index.
+// Throws std::runtime_error if the file is damaged or has an unsupported version
+SnapshotInfo ReadSnapshotInfo(const std::string& path);
@@ -1,6 +1,45 @@
+#include "async_search_server.h"
+#include "block_io.h"
+#include "bounded_queue.h"
+#include "checksum.h"
+#include "corpus_loader.h"
+#include "durable_search_server.h"
+#include "ingestion_pipeline.h"
+#include "network_server.h"
+#include "numa_topology.h"
+#include "process_queries.h"
+#include "query_limits.h"
+#include "query_scheduler.h"
+#include "read_replica.h"
+#include "remove_duplicates.h"
+#include "search_coordinator.h"
 #include "search_server.h"
+#include "shard_server.h"
+#include "sharded_search_server.h"
+#include "snapshot.h"
 #include "test_example_functions.h"
 
+#include <atomic>
+#include <chrono>
+#include <coroutine>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <future>
+#include <limits>
+#include <thread>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <signal.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
 using namespace std;
 
 // assert framework
@@ -84,6 +123,12 @@ void TestMatchingDocuments() {
         auto [words, status] = words_status;
         ASSERT_EQUAL(words.size(), 2u);
         ASSERT(status == DocumentStatus::ACTUAL);
+
+        // the words must stay valid after the query is gone
+        string query = "cat city"s;
+        const vector<string_view> par_words = get<0>(server.MatchDocument(execution::par, query, doc_id));
+        query.assign(query.size(), 'x');
+        ASSERT_EQUAL(par_words, words);
     }
     {
         SearchServer server(""s);
@@ -214,6 +259,1394 @@ void TestRelevanceDocument() {
     ASSERT(found_docs[0].relevance == relevance);
 }
 
+void TestRemoveDocuments() {
+    const vector<int> ratings = {1, 2, 3};
+    for (int parallel = 0; parallel < 2; ++parallel) {
+        SearchServer server("and"s);
+        server.AddDocument(1, "white cat and collar"s, DocumentStatus::ACTUAL, ratings);
+        server.AddDocument(2, "fluffy cat fluffy tail"s, DocumentStatus::ACTUAL, ratings);
+        server.AddDocument(3, "groomed dog expressive eyes"s, DocumentStatus::ACTUAL, ratings);
+        server.AddDocument(4, "groomed starling cat"s, DocumentStatus::ACTUAL, ratings);
+
+        const vector<int> ids = {4, 1, 4, 100};
+        if (parallel) {
+            server.RemoveDocuments(execution::par, ids);
+        }
+        else {
+            server.RemoveDocuments(ids);
+        }
+
+        ASSERT_EQUAL(server.GetDocumentCount(), 2);
+        ASSERT(server.GetWordFrequencies(1).empty());
+        const auto found_docs = server.FindTopDocuments("cat groomed"s);
+        ASSERT_EQUAL(found_docs.size(), 2u);
+        ASSERT_HINT(server.FindTopDocuments("white starling"s).empty(), "Removed documents mustn't be found"s);
+    }
+}
+
+void TestReclaimDeadWords() {
+    const vector<int> ratings = {1, 2, 3};
+    SearchServer server(""s);
+    server.AddDocument(1, "cat in the city"s, DocumentStatus::ACTUAL, ratings);
+    server.AddDocument(2, "dog in the park"s, DocumentStatus::ACTUAL, ratings);
+    ASSERT_EQUAL(server.GetReclaimedBytes(), 0u);
+
+    server.RemoveDocument(execution::par, 1);
+    const size_t reclaimed = server.GetReclaimedBytes();
+    ASSERT_HINT(reclaimed > 0, "Removal must report reclaimed memory"s);
+    ASSERT(server.FindTopDocuments("cat city"s).empty());
+
+    server.AddDocument(3, "cat in the garden"s, DocumentStatus::ACTUAL, ratings);
+    const auto found_docs = server.FindTopDocuments("cat"s);
+    ASSERT_EQUAL(found_docs.size(), 1u);
+    ASSERT_EQUAL(found_docs[0].id, 3);
+    ASSERT(found_docs[0].relevance > 0);
+
+    server.RemoveDocument(2);
+    ASSERT(server.GetReclaimedBytes() > reclaimed);
+}
+
+void TestWordFrequencies() {
+    const vector<int> ratings = {1, 2, 3};
+    SearchServer server("and"s);
+    for (int id = 0; id < 10; ++id) {
+        server.AddDocument(id, "cat and dog cat word"s + to_string(id), DocumentStatus::ACTUAL, ratings);
+    }
+    // removing most documents compacts the forward index
+    const vector<int> ids_to_remove = {0, 1, 2, 3, 4, 5, 6, 7};
+    server.RemoveDocuments(ids_to_remove);
+
+    map<string_view, double> word_freqs;
+    for (const auto [word, freq] : server.GetWordFrequencies(9)) {
+        word_freqs[word] = freq;
+    }
+    ASSERT_EQUAL(word_freqs.size(), 3u);
+    ASSERT(abs(word_freqs["cat"sv] - 0.5) < 1e-6);
+    ASSERT(abs(word_freqs["dog"sv] - 0.25) < 1e-6);
+    ASSERT(abs(word_freqs["word9"sv] - 0.25) < 1e-6);
+    ASSERT(server.GetWordFrequencies(3).empty());
+}
+
+void TestDisabledForwardIndex() {
+    const vector<int> ratings = {1, 2, 3};
+    SearchServer full_server("and"s);
+    SearchServer lean_server("and"s, SearchServerOptions{false});
+    for (int id = 0; id < 20; ++id) {
+        const string text = "cat and dog number"s + to_string(id);
+        full_server.AddDocument(id, text, DocumentStatus::ACTUAL, ratings);
+        lean_server.AddDocument(id, text, DocumentStatus::ACTUAL, ratings);
+    }
+    ASSERT_HINT(lean_server.GetMemoryUsage().Total() < full_server.GetMemoryUsage().Total(),
+        "Disabled forward index must save memory"s);
+    ASSERT_EQUAL(lean_server.GetMemoryUsage().forward_index, 0u);
+
+    bool thrown = false;
+    try {
+        lean_server.GetWordFrequencies(1);
+    } catch (const logic_error&) {
+        thrown = true;
+    }
+    ASSERT_HINT(thrown, "Word frequencies require the forward index"s);
+
+    lean_server.RemoveDocument(execution::par, 3);
+    const vector<int> ids_to_remove = {4, 5};
+    lean_server.RemoveDocuments(execution::par, ids_to_remove);
+    ASSERT_EQUAL(lean_server.GetDocumentCount(), 17);
+    ASSERT(lean_server.FindTopDocuments("number3 number4 number5"s).empty());
+    ASSERT_EQUAL(lean_server.FindTopDocuments("number6"s).size(), 1u);
+}
+
+void TestRemoveDuplicates() {
+    const vector<int> ratings = {1, 2};
+    for (const bool use_forward_index : {true, false}) {
+        SearchServer server("and with"s, SearchServerOptions{use_forward_index});
+        server.AddDocument(1, "funny pet and nasty rat"s, DocumentStatus::ACTUAL, ratings);
+        server.AddDocument(2, "funny pet with curly hair"s, DocumentStatus::ACTUAL, ratings);
+        server.AddDocument(3, "funny pet with curly hair"s, DocumentStatus::ACTUAL, ratings);
+        server.AddDocument(4, "funny pet and curly hair"s, DocumentStatus::ACTUAL, ratings);
+        server.AddDocument(5, "funny funny pet and nasty nasty rat"s, DocumentStatus::ACTUAL, ratings);
+        server.AddDocument(6, "funny pet and not very nasty rat"s, DocumentStatus::ACTUAL, ratings);
+        server.AddDocument(7, "very nasty rat and not very funny pet"s, DocumentStatus::ACTUAL, ratings);
+        server.AddDocument(8, "pet with rat and rat and rat"s, DocumentStatus::ACTUAL, ratings);
+        server.AddDocument(9, "nasty rat with curly hair"s, DocumentStatus::ACTUAL, ratings);
+
+        ASSERT(server.GetDocumentSignature(2) == server.GetDocumentSignature(3));
+        ASSERT(server.GetDocumentSignature(1) != server.GetDocumentSignature(2));
+
+        RemoveDuplicates(server);
+        ASSERT_EQUAL(server.GetDocumentCount(), 5);
+        const vector<int> remaining_ids(server.begin(), server.end());
+        ASSERT_EQUAL(remaining_ids, vector<int>({1, 2, 6, 8, 9}));
+    }
+}
+
+void TestNearDuplicates() {
+    const vector<int> ratings = {1, 2};
+    SearchServer server(""s);
+    const string boilerplate = "subscribe to our newsletter to get weekly updates about new products and discounts"s;
+    server.AddDocument(1, boilerplate + " alpha"s, DocumentStatus::ACTUAL, ratings);
+    server.AddDocument(2, "fluffy cat with long tail"s, DocumentStatus::ACTUAL, ratings);
+    server.AddDocument(3, boilerplate + " beta"s, DocumentStatus::ACTUAL, ratings);
+    server.AddDocument(4, "groomed dog with expressive eyes"s, DocumentStatus::ACTUAL, ratings);
+    server.AddDocument(5, boilerplate, DocumentStatus::ACTUAL, ratings);
+
+    NearDuplicateOptions options;
+    options.jaccard_threshold = 0.8;
+    const auto groups = FindNearDuplicates(server, options);
+    ASSERT_EQUAL(groups.size(), 1u);
+    ASSERT_EQUAL(groups[0], vector<int>({1, 3, 5}));
+
+    RemoveNearDuplicates(server, options);
+    const vector<int> remaining_ids(server.begin(), server.end());
+    ASSERT_EQUAL(remaining_ids, vector<int>({1, 2, 4}));
+
+    // one bucket holding many copies
+    SearchServer copies(""s);
+    for (int id = 0; id < 500; ++id) {
+        copies.AddDocument(id, boilerplate + (id % 2 == 0 ? " alpha"s : " beta"s), DocumentStatus::ACTUAL, ratings);
+    }
+    const auto copy_groups = FindNearDuplicates(copies, options);
+    ASSERT_EQUAL(copy_groups.size(), 1u);
+    ASSERT_EQUAL(copy_groups[0].size(), 500u);
+
+    SearchServerOptions server_options;
+    server_options.use_forward_index = false;
+    SearchServer without_forward_index(""s, server_options);
+    without_forward_index.AddDocument(1, boilerplate, DocumentStatus::ACTUAL, ratings);
+    bool thrown = false;
+    try {
+        FindNearDuplicates(without_forward_index, options);
+    } catch (const logic_error&) {
+        thrown = true;
+    }
+    ASSERT_HINT(thrown, "Near-duplicate detection must report the missing forward index"s);
+
+    for (const auto& [band_count, rows_per_band] : {pair{0, 4}, pair{16, 0}, pair{-1, 4}}) {
+        NearDuplicateOptions bad_options = options;
+        bad_options.band_count = band_count;
+        bad_options.rows_per_band = rows_per_band;
+        thrown = false;
+        try {
+            FindNearDuplicates(server, bad_options);
+        } catch (const invalid_argument&) {
+            thrown = true;
+        }
+        ASSERT_HINT(thrown, "Empty LSH bands must be rejected"s);
+    }
+}
+
+void TestDuplicatePolicy() {
+    const vector<int> ratings = {1, 2};
+    {
+        SearchServerOptions options;
+        options.duplicate_policy = DuplicatePolicy::REJECT;
+        SearchServer server("and"s, options);
+        server.AddDocument(1, "funny pet and nasty rat"s, DocumentStatus::ACTUAL, ratings);
+        bool thrown = false;
+        try {
+            server.AddDocument(2, "nasty rat and funny funny pet"s, DocumentStatus::ACTUAL, ratings);
+        } catch (const invalid_argument&) {
+            thrown = true;
+        }
+        ASSERT_HINT(thrown, "Duplicate documents must be rejected"s);
+        ASSERT_EQUAL(server.GetDocumentCount(), 1);
+
+        server.RemoveDocument(1);
+        server.AddDocument(2, "nasty rat and funny funny pet"s, DocumentStatus::ACTUAL, ratings);
+        ASSERT_EQUAL(server.GetDocumentCount(), 1);
+    }
+    for (const bool use_forward_index : {true, false}) {
+        SearchServerOptions options;
+        options.use_forward_index = use_forward_index;
+        options.duplicate_policy = DuplicatePolicy::ALIAS;
+        SearchServer server("and"s, options);
+        server.AddDocument(1, "funny pet and nasty rat"s, DocumentStatus::ACTUAL, ratings);
+        server.AddDocument(2, "funny pet"s, DocumentStatus::ACTUAL, ratings);
+        server.AddDocument(3, "rat nasty pet funny"s, DocumentStatus::ACTUAL, ratings);
+        server.AddDocument(4, "funny pet and nasty rat"s, DocumentStatus::ACTUAL, ratings);
+        ASSERT_EQUAL(server.GetDocumentCount(), 2);
+        ASSERT_EQUAL(server.FindAliasOriginal(3).value_or(0), 1);
+        ASSERT(!server.FindAliasOriginal(2).has_value());
+
+        server.RemoveDocument(4);
+        ASSERT(!server.FindAliasOriginal(4).has_value());
+        server.RemoveDocument(1);
+        ASSERT_HINT(!server.FindAliasOriginal(3).has_value(), "Aliases must be removed with their original"s);
+        server.AddDocument(5, "funny nasty rat pet"s, DocumentStatus::ACTUAL, ratings);
+        ASSERT_EQUAL(server.GetDocumentCount(), 2);
+    }
+}
+
+void TestStableText() {
+    const string text = "fluffy cat with collar"s;
+    SearchServer server("with"s);
+    server.AddDocument(1, StableText(text), DocumentStatus::ACTUAL, {1});
+    server.AddDocument(2, "fluffy dog"s, DocumentStatus::ACTUAL, {2});
+    for (const auto [word, _] : server.GetWordFrequencies(1)) {
+        ASSERT_HINT(word.data() >= text.data() && word.data() < text.data() + text.size(),
+            "Words of a stable text must not be copied"s);
+    }
+    ASSERT_EQUAL(server.FindTopDocuments("fluffy"s).size(), 2u);
+    server.RemoveDocument(1);
+    ASSERT_EQUAL(server.FindTopDocuments("fluffy collar"s).size(), 1u);
+
+    const string path = (filesystem::temp_directory_path() / "search_server_test.corpus"s).string();
+    {
+        ofstream out(path, ios::binary);
+        out << "grey parrot\nsmall grey mouse\n"s;
+    }
+    const StableText corpus = server.MapCorpus(path);
+    remove(path.c_str());
+    server.AddDocument(3, corpus.substr(0, 11), DocumentStatus::ACTUAL, {3});
+    server.AddDocument(4, corpus.substr(12, 16), DocumentStatus::ACTUAL, {4});
+    const auto found = server.FindTopDocuments("grey mouse"s);
+    ASSERT_EQUAL(found.size(), 2u);
+    ASSERT_EQUAL(found[0].id, 4);
+}
+
+void TestCorpusLoader() {
+    const string path = (filesystem::temp_directory_path() / "search_server_test.tsv"s).string();
+    {
+        ofstream out(path, ios::binary);
+        out << "1\tACTUAL\t1 2 3\twhite cat and yellow hat\n"s
+            << "2\tBANNED\t\tcurly cat curly tail\r\n"s
+            << "\n"s
+            << "3\tACTUAL\t-4\tnasty dog with big eyes\n"s
+            << "4\tIRRELEVANT\t5 7\tnasty pigeon john"s;
+    }
+
+    for (const bool zero_copy : {false, true}) {
+        CorpusLoaderOptions options;
+        options.chunk_size = 16;
+        options.max_chunks_in_flight = 2;
+        options.zero_copy = zero_copy;
+        SearchServer server("and with"s);
+        const CorpusLoadStats stats = LoadCorpus(server, path, options);
+        ASSERT_EQUAL(stats.parse.documents, 4u);
+        ASSERT_EQUAL(stats.index.documents, 4u);
+        ASSERT_EQUAL(server.GetDocumentCount(), 4);
+
+        const auto found = server.FindTopDocuments("cat dog"s);
+        ASSERT_EQUAL(found.size(), 2u);
+        ASSERT_EQUAL(found[0].id, 3);
+        ASSERT_EQUAL(found[0].rating, -4);
+        ASSERT_EQUAL(found[1].rating, 2);
+        ASSERT_EQUAL(server.FindTopDocuments("curly"s, DocumentStatus::BANNED).size(), 1u);
+        ASSERT_EQUAL(server.FindTopDocuments("john"s, DocumentStatus::IRRELEVANT)[0].rating, 6);
+    }
+
+    {
+        ofstream out(path, ios::binary);
+        out << "1\tACTUAL\t1\tcat\n"s << "2\tHIDDEN\t1\tdog\n"s;
+    }
+    SearchServer server(""s);
+    bool thrown = false;
+    try {
+        LoadCorpus(server, path);
+    } catch (const invalid_argument&) {
+        thrown = true;
+    }
+    ASSERT_HINT(thrown, "Malformed line must be rejected"s);
+    remove(path.c_str());
+}
+
+void TestIngestionPipeline() {
+    BoundedQueue<int> queue(3);
+    ASSERT_EQUAL(queue.GetCapacity(), 4u);
+    for (int i = 0; i < 4; ++i) {
+        ASSERT(queue.TryPush(i));
+    }
+    int value = 10;
+    ASSERT(!queue.TryPush(value));
+    ASSERT(queue.TryPop(value));
+    ASSERT_EQUAL(value, 0);
+    ASSERT_EQUAL(queue.GetSize(), 3u);
+
+    const string path = (filesystem::temp_directory_path() / "search_server_pipeline.tsv"s).string();
+    {
+        ofstream out(path, ios::binary);
+        for (int id = 0; id < 200; ++id) {
+            out << id << "\tACTUAL\t"s << id << "\tcommon word"s << id % 7 << (id == 42 ? " unique"s : ""s) << "\n"s;
+        }
+    }
+
+    SearchServer reference(""s);
+    LoadCorpus(reference, path);
+    for (const bool zero_copy : {false, true}) {
+        IngestionOptions options;
+        options.chunk_size = 256;
+        options.read_threads = 2;
+        options.tokenize_threads = 3;
+        options.index_threads = 2;
+        options.parsed_queue_capacity = 1;
+        options.prepared_queue_capacity = 2;
+        options.zero_copy = zero_copy;
+        SearchServer server(""s);
+        const IngestionStats stats = RunIngestionPipeline(server, path, options);
+        ASSERT_EQUAL(server.GetDocumentCount(), 200);
+        ASSERT_EQUAL(stats.read.documents, 200u);
+        ASSERT_EQUAL(stats.tokenize.documents, 200u);
+        ASSERT_EQUAL(stats.index.documents, 200u);
+        ASSERT_EQUAL(stats.parsed_queue.capacity, 2u);
+        ASSERT(stats.prepared_queue.max_depth <= 2u);
+
+        const auto found = server.FindTopDocuments("unique word0"s);
+        const auto expected = reference.FindTopDocuments("unique word0"s);
+        ASSERT_EQUAL(found.size(), expected.size());
+        ASSERT_EQUAL(found[0].id, 42);
+        for (size_t i = 0; i < found.size(); ++i) {
+            ASSERT(abs(found[i].relevance - expected[i].relevance) < 1e-12);
+        }
+    }
+
+    // the index stage rejects a repeated id, the error must stop the other stages
+    {
+        ofstream out(path, ios::app | ios::binary);
+        out << "7\tACTUAL\t1\trepeated id\n"s;
+    }
+    SearchServer server(""s);
+    bool thrown = false;
+    try {
+        RunIngestionPipeline(server, path);
+    } catch (const invalid_argument&) {
+        thrown = true;
+    }
+    ASSERT_HINT(thrown, "Pipeline must report the first error"s);
+    remove(path.c_str());
+}
+
+void TestConcurrentAddDocument() {
+    const auto make_text = [](int id) {
+        return "common word"s + to_string(id % 13) + " rare"s + to_string(id) + " word"s + to_string(id % 5);
+    };
+
+    SearchServer reference("and"s);
+    for (int id = 0; id < 800; ++id) {
+        reference.AddDocument(id, make_text(id), DocumentStatus::ACTUAL, {id % 10});
+    }
+    reference.AddDocument(1000, "repeated"s, DocumentStatus::ACTUAL, {});
+
+    SearchServer server("and"s);
+    atomic<int> accepted_repeated_ids = 0;
+    vector<thread> writers;
+    for (int writer = 0; writer < 8; ++writer) {
+        writers.emplace_back([&, writer] {
+            for (int id = writer; id < 800; id += 8) {
+                server.AddDocument(id, make_text(id), DocumentStatus::ACTUAL, {id % 10});
+            }
+            // exactly one of the writers may take a repeated id
+            try {
+                server.AddDocument(1000, "repeated"s, DocumentStatus::ACTUAL, {});
+                ++accepted_repeated_ids;
+            } catch (const invalid_argument&) {
+            }
+        });
+    }
+    for (thread& writer : writers) {
+        writer.join();
+    }
+
+    ASSERT_EQUAL(accepted_repeated_ids.load(), 1);
+    ASSERT_EQUAL(server.GetDocumentCount(), 801);
+    for (const string& query : {"word3 rare17"s, "common -word4"s, "word12 word0"s}) {
+        const auto expected = reference.FindTopDocuments(query);
+        const auto actual = server.FindTopDocuments(query);
+        ASSERT_EQUAL(actual.size(), expected.size());
+        for (size_t i = 0; i < actual.size(); ++i) {
+            ASSERT(abs(actual[i].relevance - expected[i].relevance) < 1e-12);
+            ASSERT_EQUAL(actual[i].rating, expected[i].rating);
+        }
+    }
+    ASSERT_EQUAL(server.GetWordFrequencies(17).size(), 4u);
+    ASSERT(server.HaveSameWords(17, 17));
+
+    // concurrent copies of one text, only the first committed is indexed
+    SearchServerOptions options;
+    options.duplicate_policy = DuplicatePolicy::ALIAS;
+    SearchServer deduplicating(""s, options);
+    writers.clear();
+    for (int writer = 0; writer < 8; ++writer) {
+        writers.emplace_back([&deduplicating, writer] {
+            deduplicating.AddDocument(writer, "same old text"s, DocumentStatus::ACTUAL, {});
+        });
+    }
+    for (thread& writer : writers) {
+        writer.join();
+    }
+    ASSERT_EQUAL(deduplicating.GetDocumentCount(), 1);
+}
+
+void TestShardedSearchServer() {
+    SearchServer reference("and with"s);
+    ShardedSearchServer sharded("and with"s, 3);
+    ASSERT_EQUAL(sharded.GetShardCount(), 3u);
+    for (int id = 0; id < 60; ++id) {
+        const string text = "cat"s + to_string(id % 4) + " dog"s + to_string(id % 9) + " and bird"s + to_string(id % 2)
+            + (id % 3 == 0 ? " fox"s : ""s);
+        reference.AddDocument(id, text, id % 5 == 0 ? DocumentStatus::BANNED : DocumentStatus::ACTUAL, {id});
+        sharded.AddDocument(id, text, id % 5 == 0 ? DocumentStatus::BANNED : DocumentStatus::ACTUAL, {id});
+    }
+    ASSERT_EQUAL(sharded.GetDocumentCount(), 60);
+
+    const auto check_queries = [&] {
+        for (const string& query : {"cat1 dog2 fox"s, "bird0 -cat3"s, "dog8 dog4 cat0"s, "elephant"s}) {
+            const auto expected = reference.FindTopDocuments(query);
+            const auto actual = sharded.FindTopDocuments(query);
+            ASSERT_EQUAL(actual.size(), expected.size());
+            for (size_t i = 0; i < actual.size(); ++i) {
+                ASSERT_EQUAL(actual[i].id, expected[i].id);
+                ASSERT_HINT(actual[i].relevance == expected[i].relevance, "Sharding must not change relevance"s);
+            }
+        }
+        const auto banned = sharded.FindTopDocuments("fox"s, DocumentStatus::BANNED);
+        ASSERT_EQUAL(banned.size(), reference.FindTopDocuments("fox"s, DocumentStatus::BANNED).size());
+    };
+    check_queries();
+
+    const auto [words, status] = sharded.MatchDocument("fox cat2 -dog5"s, 6);
+    ASSERT_EQUAL(words.size(), 2u);
+    ASSERT(status == DocumentStatus::ACTUAL);
+
+    for (int id = 0; id < 60; id += 7) {
+        reference.RemoveDocument(id);
+        sharded.RemoveDocument(id);
+    }
+    ASSERT_EQUAL(sharded.GetDocumentCount(), reference.GetDocumentCount());
+    check_queries();
+
+    bool thrown = false;
+    try {
+        sharded.FindTopDocuments("cat --dog"s);
+    } catch (const invalid_argument&) {
+        thrown = true;
+    }
+    ASSERT_HINT(thrown, "Query errors must reach the caller"s);
+
+    // a word added to a shard after the statistics were collected doesn't rank
+    CorpusStatistics statistics;
+    reference.CollectStatistics("cat1 giraffe"s, statistics);
+    reference.AddDocument(100, "giraffe"s, DocumentStatus::ACTUAL, {1});
+    const auto documents = reference.FindTopDocuments(execution::seq, "cat1 giraffe"s,
+        [](int, DocumentStatus, int) { return true; }, statistics);
+    ASSERT(!documents.empty());
+    for (const Document& document : documents) {
+        ASSERT(document.id != 100);
+    }
+    ASSERT_EQUAL(reference.FindTopDocuments(execution::par, "giraffe"s,
+        [](int, DocumentStatus, int) { return true; }, statistics).size(), 0u);
+}
+
+void TestNumaPlacement() {
+    ASSERT_EQUAL(ParseCpuList("0-2,5\n"s), (vector<int>{0, 1, 2, 5}));
+    bool thrown = false;
+    try {
+        ParseCpuList("3-1"s);
+    } catch (const invalid_argument&) {
+        thrown = true;
+    }
+    ASSERT(thrown);
+
+    const filesystem::path sysfs = filesystem::temp_directory_path() / "search_server_test_nodes"s;
+    filesystem::remove_all(sysfs);
+    filesystem::create_directories(sysfs / "node1"s);
+    filesystem::create_directories(sysfs / "node0"s);
+    filesystem::create_directories(sysfs / "node2"s);
+    filesystem::create_directories(sysfs / "power"s);
+    ofstream(sysfs / "node1"s / "cpulist"s) << "2-3\n"s;
+    ofstream(sysfs / "node0"s / "cpulist"s) << "0-1\n"s;
+    ofstream(sysfs / "node2"s / "cpulist"s) << "\n"s;
+    const NumaTopology detected = NumaTopology::Detect(sysfs.string());
+    filesystem::remove_all(sysfs);
+    ASSERT_EQUAL(detected.GetNodes().size(), 2u);
+    ASSERT_EQUAL(detected.GetNodes()[1].id, 1);
+    ASSERT_EQUAL(detected.GetNodeIndexOfCpu(3), 1);
+    ASSERT_EQUAL(detected.GetNodeIndexOfCpu(7), -1);
+    ASSERT(!NumaTopology::Detect((sysfs / "missing"s).string()).GetNodes().empty());
+
+    // both fake nodes own every CPU, so pinning succeeds on any machine
+    vector<int> all_cpus;
+    for (int cpu = 0; cpu < static_cast<int>(max(thread::hardware_concurrency(), 1u)); ++cpu) {
+        all_cpus.push_back(cpu);
+    }
+    ShardedSearchServer sharded("and"s, 4, {}, NumaTopology({{0, all_cpus}, {1, all_cpus}}));
+    for (int id = 0; id < 20; ++id) {
+        sharded.AddDocument(id, "cat and dog"s + to_string(id % 3), DocumentStatus::ACTUAL, {id});
+    }
+    ASSERT_EQUAL(sharded.FindTopDocuments("dog1"s).size(), 5u);
+
+    const vector<ShardWorkerStats> stats = sharded.GetPlacementStats();
+    ASSERT_EQUAL(stats.size(), 4u);
+    size_t tasks = 0;
+    for (size_t shard = 0; shard < stats.size(); ++shard) {
+        ASSERT_EQUAL(stats[shard].node_index, static_cast<int>(shard % 2));
+        ASSERT(stats[shard].binding.pinned);
+        ASSERT(stats[shard].tasks >= 3u);
+        tasks += stats[shard].tasks;
+    }
+    // construction, 20 additions, statistics and search on every shard
+    ASSERT_EQUAL(tasks, 4u + 20u + 4u + 4u);
+}
+
+void TestSearchCoordinator() {
+    SearchServer reference("and with"s);
+    vector<SearchServer> shards(3, SearchServer("and with"s));
+    for (int id = 0; id < 45; ++id) {
+        const string text = "cat"s + to_string(id % 4) + " dog"s + to_string(id % 7) + (id % 3 == 1 ? " and fox"s : ""s);
+        reference.AddDocument(id, text, DocumentStatus::ACTUAL, {id % 10});
+        shards[id % 3].AddDocument(id, text, DocumentStatus::ACTUAL, {id % 10});
+    }
+
+    // every shard is a separate process, the readiness pipe says when it listens
+    vector<string> paths;
+    vector<pid_t> children;
+    for (size_t shard = 0; shard < shards.size(); ++shard) {
+        paths.push_back((filesystem::temp_directory_path() / ("search_server_test_shard"s + to_string(shard) + ".sock"s)).string());
+        int ready[2];
+        ASSERT(pipe(ready) == 0);
+        const pid_t child = fork();
+        ASSERT(child >= 0);
+        if (child == 0) {
+            close(ready[0]);
+            try {
+                ShardServer server(shards[shard], paths.back());
+                ASSERT(write(ready[1], "", 1) == 1);
+                server.Run();
+            } catch (...) {
+            }
+            _exit(0);
+        }
+        close(ready[1]);
+        char byte = 0;
+        ASSERT(read(ready[0], &byte, 1) == 1);
+        close(ready[0]);
+        children.push_back(child);
+    }
+
+    SearchCoordinator coordinator(paths, {chrono::milliseconds(5000)});
+    for (const string& query : {"cat1 dog2 fox"s, "fox -cat3"s, "dog6 cat0"s, "elephant"s}) {
+        const auto expected = reference.FindTopDocuments(query);
+        const CoordinatedSearchResult actual = coordinator.FindTopDocuments(query);
+        ASSERT(!actual.IsPartial());
+        ASSERT_EQUAL(actual.answered_shards, 3u);
+        ASSERT_EQUAL(actual.statistics_shards, 3u);
+        ASSERT_EQUAL(actual.documents.size(), expected.size());
+        for (size_t i = 0; i < expected.size(); ++i) {
+            ASSERT_EQUAL(actual.documents[i].id, expected[i].id);
+            ASSERT_HINT(actual.documents[i].relevance == expected[i].relevance, "Shards must rank with the global IDF"s);
+        }
+    }
+    bool thrown = false;
+    try {
+        coordinator.FindTopDocuments("cat --dog"s);
+    } catch (const invalid_argument&) {
+        thrown = true;
+    }
+    ASSERT_HINT(thrown, "Query errors must reach the caller"s);
+
+    // a stopped shard times out and the others still answer
+    SearchCoordinator impatient(paths, {chrono::milliseconds(200)});
+    kill(children[2], SIGSTOP);
+    CoordinatedSearchResult partial = impatient.FindTopDocuments("cat1 fox"s);
+    ASSERT(partial.IsPartial());
+    ASSERT_EQUAL(partial.answered_shards, 2u);
+    ASSERT_EQUAL(partial.statistics_shards, 2u);
+    ASSERT_EQUAL(partial.failures.size(), 1u);
+    ASSERT_EQUAL(partial.failures[0].shard, 2u);
+    ASSERT(!partial.documents.empty());
+    for (const Document& document : partial.documents) {
+        ASSERT(document.id % 3 != 2);
+    }
+    kill(children[2], SIGCONT);
+    ASSERT(!impatient.FindTopDocuments("cat1 fox"s).IsPartial());
+
+    kill(children[1], SIGKILL);
+    waitpid(children[1], nullptr, 0);
+    partial = coordinator.FindTopDocuments("cat1 fox"s);
+    ASSERT_EQUAL(partial.failures.size(), 1u);
+    ASSERT_EQUAL(partial.failures[0].shard, 1u);
+
+    for (size_t shard = 0; shard < children.size(); ++shard) {
+        kill(children[shard], SIGKILL);
+        waitpid(children[shard], nullptr, 0);
+        remove(paths[shard].c_str());
+    }
+}
+
+void TestNetworkServer() {
+    SearchServer search_server("and with"s);
+    for (int id = 0; id < 30; ++id) {
+        search_server.AddDocument(id, "cat"s + to_string(id % 4) + " dog"s + to_string(id % 5), DocumentStatus::ACTUAL, {id});
+    }
+    NetworkServerOptions options;
+    options.worker_threads = 2;
+    NetworkServer network_server(search_server, options);
+    thread event_loop([&network_server] { network_server.Run(); });
+
+    const auto connect_to = [](const NetworkServer& server) {
+        const int fd = socket(AF_INET, SOCK_STREAM, 0);
+        sockaddr_in address = {};
+        address.sin_family = AF_INET;
+        address.sin_port = htons(server.GetPort());
+        inet_pton(AF_INET, "127.0.0.1", &address.sin_addr);
+        ASSERT(connect(fd, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) == 0);
+        return fd;
+    };
+    const auto connect_loopback = [&] {
+        return connect_to(network_server);
+    };
+    // reads until size bytes are there or the server closes
+    const auto receive = [](int fd, string& data, size_t size) {
+        char buffer[4096];
+        while (data.size() < size) {
+            const ssize_t result = recv(fd, buffer, sizeof(buffer), 0);
+            if (result <= 0) {
+                return;
+            }
+            data.append(buffer, static_cast<size_t>(result));
+        }
+    };
+
+    // pipelined binary requests in one write, answered in order
+    int fd = connect_loopback();
+    const vector<string> queries = {"cat1 dog2"s, "cat --dog"s, "dog3"s};
+    string requests;
+    for (const string& query : queries) {
+        requests += EncodeNetworkRequest(query);
+    }
+    ASSERT(send(fd, requests.data(), requests.size(), 0) == static_cast<ssize_t>(requests.size()));
+    string received;
+    for (size_t i = 0; i < queries.size(); ++i) {
+        receive(fd, received, 4);
+        const size_t frame_size = GetNetworkFrameSize(received);
+        receive(fd, received, frame_size);
+        const NetworkResponse response = DecodeNetworkResponse(string_view(received).substr(0, frame_size));
+        received.erase(0, frame_size);
+        if (i == 1) {
+            ASSERT(response.status == NetworkResponseStatus::INVALID_QUERY);
+            ASSERT(!response.error.empty());
+            continue;
+        }
+        const auto expected = search_server.FindTopDocuments(queries[i]);
+        ASSERT(response.status == NetworkResponseStatus::OK);
+        ASSERT_EQUAL(response.documents.size(), expected.size());
+        for (size_t j = 0; j < expected.size(); ++j) {
+            ASSERT_EQUAL(response.documents[j].id, expected[j].id);
+            ASSERT(response.documents[j].relevance == expected[j].relevance);
+            ASSERT_EQUAL(response.documents[j].rating, expected[j].rating);
+        }
+    }
+    close(fd);
+
+    // HTTP keep-alive with pipelining, the second request closes the connection
+    fd = connect_loopback();
+    requests = "GET /search?query=cat2+dog2 HTTP/1.1\r\nHost: localhost\r\n\r\n"s
+        "GET /search?query=%63at3 HTTP/1.1\r\nConnection: close\r\n\r\n"s;
+    ASSERT(send(fd, requests.data(), requests.size(), 0) == static_cast<ssize_t>(requests.size()));
+    received.clear();
+    receive(fd, received, numeric_limits<size_t>::max());
+    close(fd);
+    const size_t second = received.find("HTTP/1.1 200 OK\r\n"s, 1);
+    ASSERT(received.rfind("HTTP/1.1 200 OK\r\n"s, 0) == 0 && second != string::npos);
+    ASSERT(received.find("{\"id\":"s + to_string(search_server.FindTopDocuments("cat2 dog2"s)[0].id) + ","s) < second);
+    ASSERT(received.find("{\"id\":"s + to_string(search_server.FindTopDocuments("cat3"s)[0].id) + ","s, second) != string::npos);
+    ASSERT(received.find("Connection: close"s, second) != string::npos);
+
+    fd = connect_loopback();
+    requests = "POST /search HTTP/1.1\r\nContent-Length: 3\r\n\r\ncat"s;
+    ASSERT(send(fd, requests.data(), requests.size(), 0) == static_cast<ssize_t>(requests.size()));
+    received.clear();
+    receive(fd, received, numeric_limits<size_t>::max());
+    close(fd);
+    ASSERT(received.rfind("HTTP/1.1 400 Bad Request\r\n"s, 0) == 0);
+
+    network_server.Stop();
+    event_loop.join();
+    const NetworkServerStats stats = network_server.GetStats();
+    ASSERT_EQUAL(stats.connections, 3u);
+    ASSERT_EQUAL(stats.requests, 6u);
+    ASSERT_EQUAL(stats.http_requests, 3u);
+    // requests that arrive together share a ProcessQueries call
+    ASSERT(stats.batches >= 2u && stats.batches < 5u);
+
+    // requests beyond the pipeline limit wait in the input and are read once answers leave
+    options.max_pipelined_requests = 2;
+    NetworkServer limited_server(search_server, options);
+    thread limited_loop([&limited_server] { limited_server.Run(); });
+    fd = connect_to(limited_server);
+    requests.clear();
+    for (int i = 0; i < 5; ++i) {
+        requests += EncodeNetworkRequest("dog"s + to_string(i));
+    }
+    ASSERT(send(fd, requests.data(), requests.size(), 0) == static_cast<ssize_t>(requests.size()));
+    timeval timeout = {5, 0};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    received.clear();
+    for (int i = 0; i < 5; ++i) {
+        receive(fd, received, 4);
+        const size_t frame_size = GetNetworkFrameSize(received);
+        receive(fd, received, frame_size);
+        ASSERT_HINT(frame_size != 0 && received.size() >= frame_size, "Every pipelined request must be answered"s);
+        const NetworkResponse response = DecodeNetworkResponse(string_view(received).substr(0, frame_size));
+        received.erase(0, frame_size);
+        ASSERT(response.status == NetworkResponseStatus::OK);
+        ASSERT_EQUAL(response.documents.size(), search_server.FindTopDocuments("dog"s + to_string(i)).size());
+    }
+    close(fd);
+    limited_server.Stop();
+    limited_loop.join();
+    ASSERT_EQUAL(limited_server.GetStats().requests, 5u);
+}
+
+void TestReadReplica() {
+    const auto directory = filesystem::temp_directory_path();
+    const string snapshot_path = (directory / "replica_test.snapshot"s).string();
+    const string log_path = (directory / "replica_test.log"s).string();
+    remove(snapshot_path.c_str());
+    remove(log_path.c_str());
+
+    WriteAheadLogOptions log_options;
+    log_options.group_commit_window = chrono::microseconds(0);
+    DurableSearchServer primary("and"s, snapshot_path, log_path, {}, log_options);
+    for (int id = 0; id < 10; ++id) {
+        primary.AddDocument(id, "cat and dog"s + to_string(id % 3), DocumentStatus::ACTUAL, {id});
+    }
+    primary.Checkpoint();
+    for (int id = 10; id < 15; ++id) {
+        primary.AddDocument(id, "cat and dog"s + to_string(id % 3), DocumentStatus::ACTUAL, {id});
+    }
+
+    const auto check_same = [&primary](ReadReplica& replica) {
+        ASSERT_EQUAL(replica.GetDocumentCount(), primary.GetSearchServer().GetDocumentCount());
+        const auto expected = primary.GetSearchServer().FindTopDocuments("dog1 cat"s);
+        const auto actual = replica.FindTopDocuments("dog1 cat"s);
+        ASSERT_EQUAL(actual.size(), expected.size());
+        for (size_t i = 0; i < expected.size(); ++i) {
+            ASSERT_EQUAL(actual[i].id, expected[i].id);
+            ASSERT(actual[i].relevance == expected[i].relevance);
+        }
+        const ReplicationStatus status = replica.GetStatus();
+        ASSERT_EQUAL(status.applied_sequence_number, primary.GetLastSequenceNumber());
+        ASSERT_EQUAL(status.GetLagRecords(), 0u);
+    };
+
+    // the manual replica only moves on CatchUp, the other one follows by itself
+    ReadReplicaOptions manual_options;
+    manual_options.poll_interval = chrono::hours(1);
+    manual_options.max_staleness = chrono::hours(1);
+    ReadReplica manual("and"s, snapshot_path, log_path, manual_options);
+    ReadReplicaOptions follower_options;
+    follower_options.poll_interval = chrono::milliseconds(1);
+    ReadReplica follower("and"s, snapshot_path, log_path, follower_options);
+    check_same(manual);
+    ASSERT_EQUAL(manual.GetStatus().bootstraps, 1u);
+
+    primary.RemoveDocument(3);
+    primary.AddDocument(15, "dog1 parrot"s, DocumentStatus::ACTUAL, {1});
+    ASSERT_EQUAL(manual.GetDocumentCount(), 15);
+    manual.CatchUp();
+    check_same(manual);
+
+    // records written after a checkpoint are read from the start of the truncated log
+    primary.Checkpoint();
+    primary.AddDocument(16, "dog1"s, DocumentStatus::ACTUAL, {1});
+    manual.CatchUp();
+    check_same(manual);
+    ASSERT_EQUAL(manual.GetStatus().bootstraps, 1u);
+
+    // records the replica missed were truncated, it has to load the snapshot again
+    primary.AddDocument(17, "dog1 cat"s, DocumentStatus::ACTUAL, {1});
+    primary.Checkpoint();
+    primary.AddDocument(18, "dog2"s, DocumentStatus::ACTUAL, {1});
+    manual.CatchUp();
+    check_same(manual);
+    ASSERT_EQUAL(manual.GetStatus().bootstraps, 2u);
+
+    const auto deadline = chrono::steady_clock::now() + chrono::seconds(10);
+    while (follower.GetStatus().applied_sequence_number != primary.GetLastSequenceNumber() && chrono::steady_clock::now() < deadline) {
+        this_thread::sleep_for(chrono::milliseconds(1));
+    }
+    check_same(follower);
+
+    // a replica that doesn't catch up refuses to answer
+    ReadReplicaOptions strict_options;
+    strict_options.poll_interval = chrono::hours(1);
+    strict_options.max_staleness = chrono::milliseconds(20);
+    ReadReplica strict("and"s, snapshot_path, log_path, strict_options);
+    this_thread::sleep_for(chrono::milliseconds(50));
+    bool thrown = false;
+    try {
+        strict.FindTopDocuments("dog1"s);
+    } catch (const runtime_error&) {
+        thrown = true;
+    }
+    ASSERT_HINT(thrown, "Replication lag must be bounded"s);
+    strict.CatchUp();
+    ASSERT(!strict.FindTopDocuments("dog1"s).empty());
+
+    remove(snapshot_path.c_str());
+    remove(log_path.c_str());
+}
+
+void TestProcessQueriesBatch() {
+    SearchServer search_server("and with"s);
+    // ids far apart, so documents fall into several accumulator blocks
+    for (int id = 0; id < 40; ++id) {
+        search_server.AddDocument(id * 1000, "cat"s + to_string(id % 4) + " dog"s + to_string(id % 6) + " bird"s,
+            id % 7 == 0 ? DocumentStatus::BANNED : DocumentStatus::ACTUAL, {id});
+    }
+    const vector<string> texts = {"cat1 dog2"s, "bird -cat3"s, "cat1 dog2"s, "elephant"s, "dog5 cat0 bird"s, "bird -cat3"s};
+    const vector<string_view> queries(texts.begin(), texts.end());
+
+    const auto results = ProcessQueries(search_server, span<const string_view>(queries));
+    ASSERT_EQUAL(results.size(), queries.size());
+    for (size_t i = 0; i < queries.size(); ++i) {
+        const auto expected = search_server.FindTopDocuments(queries[i]);
+        ASSERT_EQUAL(results[i].size(), expected.size());
+        for (size_t j = 0; j < expected.size(); ++j) {
+            ASSERT_EQUAL(results[i][j].id, expected[j].id);
+            ASSERT_HINT(results[i][j].relevance == expected[j].relevance, "Batching must not change relevance"s);
+            ASSERT_EQUAL(results[i][j].rating, expected[j].rating);
+        }
+    }
+    ASSERT_EQUAL(ProcessQueries(search_server, texts).size(), texts.size());
+    ASSERT_EQUAL(search_server.FindTopDocumentsBatch(queries, DocumentStatus::BANNED)[1].size(),
+        search_server.FindTopDocuments("bird -cat3"s, DocumentStatus::BANNED).size());
+
+    const vector<string_view> invalid = {"cat1"sv, "cat --dog"sv};
+    bool thrown = false;
+    try {
+        ProcessQueries(search_server, span<const string_view>(invalid));
+    } catch (const invalid_argument&) {
+        thrown = true;
+    }
+    ASSERT(thrown);
+}
+
+void TestProcessQueriesJoinedStream() {
+    SearchServer search_server("and with"s);
+    for (int id = 0; id < 30; ++id) {
+        search_server.AddDocument(id, "cat"s + to_string(id % 3) + " dog"s + to_string(id % 5), DocumentStatus::ACTUAL, {id});
+    }
+    vector<string> texts;
+    for (int i = 0; i < 11; ++i) {
+        texts.push_back("cat"s + to_string(i % 3) + " -dog"s + to_string(i % 5));
+    }
+    const vector<string_view> queries(texts.begin(), texts.end());
+    vector<pair<size_t, int>> expected;
+    const auto results = ProcessQueries(search_server, texts);
+    for (size_t i = 0; i < results.size(); ++i) {
+        for (const Document& document : results[i]) {
+            expected.emplace_back(i, document.id);
+        }
+    }
+
+    JoinOptions options;
+    options.batch_size = 3;
+    options.max_batches_in_flight = 2;
+    vector<pair<size_t, int>> streamed;
+    const auto collect = [&streamed](size_t query_index, const Document& document) {
+        streamed.emplace_back(query_index, document.id);
+    };
+    ProcessQueriesJoined(search_server, span<const string_view>(queries), collect, options);
+    ASSERT_HINT(streamed == expected, "Results must come in query order"s);
+
+    streamed.clear();
+    options.order = ResultOrder::AS_COMPLETED;
+    ProcessQueriesJoined(search_server, span<const string_view>(queries), collect, options);
+    sort(streamed.begin(), streamed.end());
+    sort(expected.begin(), expected.end());
+    ASSERT_EQUAL(streamed.size(), expected.size());
+    ASSERT(streamed == expected);
+    ASSERT_EQUAL(ProcessQueriesJoined(search_server, texts).size(), expected.size());
+
+    texts[7] = "cat --dog"s;
+    const vector<string_view> invalid(texts.begin(), texts.end());
+    bool thrown = false;
+    try {
+        ProcessQueriesJoined(search_server, span<const string_view>(invalid), collect, options);
+    } catch (const invalid_argument&) {
+        thrown = true;
+    }
+    ASSERT(thrown);
+}
+
+// Coroutine that starts at once and frees itself when it ends
+struct DetachedTask {
+    struct promise_type {
+        DetachedTask get_return_object() {
+            return {};
+        }
+        suspend_never initial_suspend() noexcept {
+            return {};
+        }
+        suspend_never final_suspend() noexcept {
+            return {};
+        }
+        void return_void() { }
+        void unhandled_exception() {
+            terminate();
+        }
+    };
+};
+
+DetachedTask AwaitQueries(AsyncSearchServer& server, promise<pair<size_t, bool>>& done) {
+    const vector<Document> documents = co_await server.FindTopDocumentsAsync("cat"s);
+    const auto [words, status] = co_await server.MatchDocumentAsync("cat dog"s, 1);
+    bool invalid_thrown = false;
+    try {
+        co_await server.FindTopDocumentsAsync("cat --dog"s);
+    } catch (const invalid_argument&) {
+        invalid_thrown = true;
+    }
+    done.set_value({documents.size() * 10 + words.size(), invalid_thrown});
+}
+
+// Keeps the executor thread it is resumed on busy until release is ready
+DetachedTask OccupyWorker(AsyncSearchServer& server, thread::id caller, promise<bool>& resumed_on_worker,
+    shared_future<void> release) {
+    co_await server.FindTopDocumentsAsync("cat"s);
+    const bool on_worker = this_thread::get_id() != caller;
+    resumed_on_worker.set_value(on_worker);
+    if (on_worker) {
+        release.wait();
+    }
+}
+
+void TestAsyncSearchServer() {
+    SearchServer search_server("and with"s);
+    search_server.AddDocument(1, "cat dog"s, DocumentStatus::ACTUAL, {1});
+    search_server.AddDocument(2, "cat bird"s, DocumentStatus::ACTUAL, {2});
+    search_server.AddDocument(3, "fish"s, DocumentStatus::ACTUAL, {3});
+
+    AsyncSearchOptions options;
+    options.worker_threads = 1;
+    options.max_queued_queries = 2;
+    AsyncSearchServer async_server(search_server, options);
+
+    auto documents = async_server.FindTopDocumentsFuture("cat"s);
+    auto match = async_server.MatchDocumentFuture(string("dog -fish"s), 1);
+    ASSERT_EQUAL(documents.get().size(), 2u);
+    ASSERT_EQUAL(get<0>(match.get()), vector<string_view>{"dog"sv});
+    auto invalid = async_server.FindTopDocumentsFuture("--cat"s);
+    bool thrown = false;
+    try {
+        invalid.get();
+    } catch (const invalid_argument&) {
+        thrown = true;
+    }
+    ASSERT(thrown);
+
+    promise<pair<size_t, bool>> done;
+    AwaitQueries(async_server, done);
+    const auto [counts, invalid_thrown] = done.get_future().get();
+    ASSERT_EQUAL(counts, 22u);
+    ASSERT(invalid_thrown);
+
+    // with the only worker busy the queue fills up and further queries are rejected
+    promise<void> release;
+    const shared_future<void> released = release.get_future().share();
+    for (bool on_worker = false; !on_worker;) {
+        promise<bool> resumed_on_worker;
+        OccupyWorker(async_server, this_thread::get_id(), resumed_on_worker, released);
+        on_worker = resumed_on_worker.get_future().get();
+    }
+    vector<future<vector<Document>>> queued;
+    queued.push_back(async_server.FindTopDocumentsFuture("fish"s));
+    queued.push_back(async_server.FindTopDocumentsFuture("bird"s));
+    thrown = false;
+    try {
+        async_server.FindTopDocumentsAsync("dog"s);
+    } catch (const OverloadError&) {
+        thrown = true;
+    }
+    ASSERT_HINT(thrown, "A full queue must reject queries"s);
+    ASSERT_EQUAL(async_server.GetStats().queued, 2u);
+    ASSERT_EQUAL(async_server.GetStats().rejected, 1u);
+    release.set_value();
+    for (auto& query : queued) {
+        ASSERT_EQUAL(query.get().size(), 1u);
+    }
+}
+
+void TestQueryLimits() {
+    SearchServer search_server("and with"s);
+    for (int id = 0; id < 3000; ++id) {
+        search_server.AddDocument(id, "cat dog"s + to_string(id % 10) + (id % 3 == 0 ? " bird"s : ""s), DocumentStatus::ACTUAL, {id});
+    }
+
+    const QueryLimits unlimited;
+    const TopDocumentsResult full = search_server.FindTopDocuments("cat dog1 -bird"s, DocumentStatus::ACTUAL, unlimited);
+    ASSERT(!full.truncated);
+    const auto expected = search_server.FindTopDocuments("cat dog1 -bird"s);
+    ASSERT_EQUAL(full.documents.size(), expected.size());
+    for (size_t i = 0; i < expected.size(); ++i) {
+        ASSERT_EQUAL(full.documents[i].id, expected[i].id);
+    }
+
+    const TopDocumentsResult expired = search_server.FindTopDocuments("cat"s, DocumentStatus::ACTUAL,
+        QueryLimits::WithTimeout(-chrono::milliseconds(1)));
+    ASSERT(expired.truncated);
+    ASSERT(expired.documents.empty());
+    ASSERT(search_server.FindTopDocuments("cat dog1 dog2 bird"s, DocumentStatus::ACTUAL,
+        QueryLimits::WithTimeout(-chrono::milliseconds(1))).documents.empty());
+
+    QueryLimits cancelled;
+    cancelled.cancellation.emplace();
+    ASSERT(!search_server.FindTopDocuments("cat -bird"s, DocumentStatus::ACTUAL, cancelled).truncated);
+    cancelled.cancellation->Cancel();
+    ASSERT(search_server.FindTopDocuments("cat -bird"s, DocumentStatus::ACTUAL, cancelled).truncated);
+
+    cancelled.on_expiry = ExpiryPolicy::THROW;
+    bool thrown = false;
+    try {
+        search_server.FindTopDocuments("cat"s, DocumentStatus::ACTUAL, cancelled);
+    } catch (const QueryInterruptedError&) {
+        thrown = true;
+    }
+    ASSERT(thrown);
+
+    const vector<string_view> queries = {"cat"sv, "dog3 -bird"sv};
+    const auto batch = ProcessQueries(search_server, span<const string_view>(queries), unlimited);
+    const auto plain = ProcessQueries(search_server, span<const string_view>(queries));
+    for (size_t i = 0; i < queries.size(); ++i) {
+        ASSERT(!batch[i].truncated);
+        ASSERT_EQUAL(batch[i].documents.size(), plain[i].size());
+    }
+    cancelled.on_expiry = ExpiryPolicy::RETURN_PARTIAL;
+    for (const TopDocumentsResult& result : ProcessQueries(search_server, span<const string_view>(queries), cancelled)) {
+        ASSERT(result.truncated);
+        ASSERT(result.documents.empty());
+    }
+    cancelled.on_expiry = ExpiryPolicy::THROW;
+    thrown = false;
+    try {
+        ProcessQueries(search_server, span<const string_view>(queries), cancelled);
+    } catch (const QueryInterruptedError&) {
+        thrown = true;
+    }
+    ASSERT(thrown);
+}
+
+void TestQueryScheduler() {
+    SearchServer search_server("and with"s);
+    search_server.AddDocument(1, "cat dog"s, DocumentStatus::ACTUAL, {1});
+    search_server.AddDocument(2, "cat bird"s, DocumentStatus::ACTUAL, {2});
+
+    QuerySchedulerOptions options;
+    options.worker_threads = 1;
+    options.classes.push_back({"interactive"s, 4.0, 0, 16, chrono::milliseconds(0)});
+    options.classes.push_back({"bulk"s, 1.0, 1, 3, chrono::milliseconds(0)});
+    options.classes.push_back({"best effort"s, 1.0, 0, 16, chrono::milliseconds(20)});
+    QueryScheduler scheduler(search_server, options);
+
+    ASSERT_EQUAL(scheduler.FindTopDocuments(0, "cat"s).get().size(), 2u);
+    const auto batch = scheduler.ProcessQueries(1, {"dog"s, "bird"s, "fish"s}).get();
+    ASSERT_EQUAL(batch.size(), 3u);
+    ASSERT_EQUAL(batch[1][0].id, 2);
+
+    // the only worker waits for release, meanwhile both classes queue up
+    const auto occupy_worker = [&scheduler](shared_future<void> release) {
+        promise<void> started;
+        auto blocker = scheduler.Submit(0, [&started, release] {
+            started.set_value();
+            release.wait();
+        });
+        started.get_future().wait();
+        return blocker;
+    };
+    promise<void> release;
+    auto blocker = occupy_worker(release.get_future().share());
+    mutex order_mutex;
+    string order;
+    vector<future<void>> jobs;
+    for (const char label : "bbbii"s) {
+        jobs.push_back(scheduler.Submit(label == 'b' ? 1 : 0, [&order_mutex, &order, label] {
+            lock_guard guard(order_mutex);
+            order += label;
+        }));
+    }
+    bool thrown = false;
+    try {
+        scheduler.FindTopDocuments(1, "cat"s);
+    } catch (const OverloadError&) {
+        thrown = true;
+    }
+    ASSERT_HINT(thrown, "A full class queue must reject queries"s);
+    ASSERT_EQUAL(scheduler.GetStats(1).rejected, 1u);
+    ASSERT_EQUAL(scheduler.GetStats(1).queued, 3u);
+    release.set_value();
+    blocker.get();
+    for (auto& job : jobs) {
+        job.get();
+    }
+    // bulk was already charged for its batch of three, interactive queries cost a quarter each
+    ASSERT_HINT(order == "iibbb"s, "The heavier class must overtake the queued bulk work"s);
+
+    // a query that waited past its class limit is shed instead of run
+    promise<void> second_release;
+    blocker = occupy_worker(second_release.get_future().share());
+    auto stale = scheduler.FindTopDocuments(2, "cat"s);
+    this_thread::sleep_for(chrono::milliseconds(50));
+    second_release.set_value();
+    thrown = false;
+    try {
+        stale.get();
+    } catch (const OverloadError&) {
+        thrown = true;
+    }
+    ASSERT(thrown);
+    blocker.get();
+
+    const PriorityClassStats bulk = scheduler.GetStats(1);
+    ASSERT_EQUAL(bulk.completed, 4u);
+    ASSERT_EQUAL(bulk.running, 0u);
+    ASSERT(bulk.max_queue_wait > chrono::steady_clock::duration::zero());
+    ASSERT(bulk.total_execution_time > chrono::steady_clock::duration::zero());
+    ASSERT_EQUAL(scheduler.GetStats(2).shed, 1u);
+    ASSERT_EQUAL(scheduler.GetStats(2).completed, 0u);
+}
+
+void TestWriteBlocks() {
+    const string path = (filesystem::temp_directory_path() / "search_server_test.blocks"s).string();
+    const string first(10000, 'a');
+    const string second = "block"s;
+    {
+        FILE* file = fopen(path.c_str(), "w+b");
+        ASSERT(file != nullptr);
+        const vector<WriteRequest> requests = {{second.data(), second.size(), 20000}, {first.data(), first.size(), 0}};
+        WriteBlocks(fileno(file), requests);
+        fclose(file);
+    }
+
+    ifstream in(path, ios::binary);
+    const string content{istreambuf_iterator<char>(in), istreambuf_iterator<char>()};
+    ASSERT_EQUAL(content.size(), 20005u);
+    ASSERT_EQUAL(content.substr(0, first.size()), first);
+    ASSERT_EQUAL(content.substr(first.size(), 10000), string(10000, '\0'));
+    ASSERT_EQUAL(content.substr(20000), second);
+
+    // more blocks than the submission ring holds, written back to front
+    string blocks;
+    for (int i = 0; i < 300; ++i) {
+        blocks += string(1000, static_cast<char>('a' + i % 26));
+    }
+    vector<WriteRequest> block_requests;
+    for (size_t i = 300; i > 0; --i) {
+        block_requests.push_back({blocks.data() + (i - 1) * 1000, 1000, (i - 1) * 1000});
+    }
+    {
+        FILE* file = fopen(path.c_str(), "w+b");
+        ASSERT(file != nullptr);
+        WriteBlocks(fileno(file), block_requests);
+        fclose(file);
+    }
+    ifstream blocks_in(path, ios::binary);
+    ASSERT(string(istreambuf_iterator<char>(blocks_in), istreambuf_iterator<char>()) == blocks);
+    remove(path.c_str());
+}
+
+void TestSnapshot() {
+    const string path = (filesystem::temp_directory_path() / "search_server_test.snapshot"s).string();
+    SearchServerOptions options;
+    options.duplicate_policy = DuplicatePolicy::ALIAS;
+    SearchServer server("and with"s, options);
+    server.AddDocument(1, "white cat and yellow hat"s, DocumentStatus::ACTUAL, {1, 2});
+    server.AddDocument(2, "curly cat curly tail"s, DocumentStatus::ACTUAL, {7, 2, 7});
+    server.AddDocument(3, "nasty dog with big eyes"s, DocumentStatus::BANNED, {5, -12, 2, 1});
+    server.AddDocument(4, "nasty pigeon john"s, DocumentStatus::ACTUAL, {4});
+    server.AddDocument(5, "john pigeon nasty"s, DocumentStatus::ACTUAL, {4});
+    server.RemoveDocument(1);
+    server.SaveSnapshot(path);
+
+    const SearchServer loaded = SearchServer::LoadSnapshot(path);
+    ASSERT_EQUAL(loaded.GetDocumentCount(), server.GetDocumentCount());
+    ASSERT_EQUAL(loaded.FindAliasOriginal(5).value_or(0), 4);
+    for (const string& query : {"curly nasty cat"s, "nasty -dog"s, "with hat"s}) {
+        const auto expected = server.FindTopDocuments(query);
+        const auto actual = loaded.FindTopDocuments(query);
+        ASSERT_EQUAL(actual.size(), expected.size());
+        for (size_t i = 0; i < actual.size(); ++i) {
+            ASSERT_EQUAL(actual[i].id, expected[i].id);
+            ASSERT_EQUAL(actual[i].rating, expected[i].rating);
+            ASSERT(abs(actual[i].relevance - expected[i].relevance) < 1e-12);
+        }
+    }
+    ASSERT_EQUAL(loaded.FindTopDocuments("dog"s, DocumentStatus::BANNED).size(), 1u);
+    ASSERT_EQUAL(loaded.GetWordFrequencies(2).size(), 3u);
+    ASSERT(loaded.GetDocumentSignature(4) == server.GetDocumentSignature(4));
+
+    // any damaged byte must be detected
+    {
+        fstream file(path, ios::in | ios::out | ios::binary);
+        file.seekp(SNAPSHOT_PAGE_SIZE + 2);
+        file.put('#');
+    }
+    bool thrown = false;
+    try {
+        SearchServer::LoadSnapshot(path);
+    } catch (const runtime_error&) {
+        thrown = true;
+    }
+    ASSERT_HINT(thrown, "Damaged snapshot must be rejected"s);
+
+    // a forward index entry with an unknown word id is rejected even when the checksums match
+    server.SaveSnapshot(path);
+    string content;
+    {
+        ifstream in(path, ios::binary);
+        content.assign(istreambuf_iterator<char>(in), istreambuf_iterator<char>());
+    }
+    SnapshotHeader header;
+    memcpy(&header, content.data(), sizeof(header));
+    for (SnapshotSectionInfo& info : span(header.sections, header.section_count)) {
+        SnapshotDocumentChunkHeader chunk_header;
+        memcpy(&chunk_header, content.data() + info.offset, sizeof(chunk_header));
+        if (info.type != SnapshotSection::DOCUMENTS || chunk_header.forward_entry_count == 0) {
+            continue;
+        }
+        const size_t entry_offset = info.offset + sizeof(chunk_header) + chunk_header.document_count * sizeof(SnapshotDocumentRecord)
+            + chunk_header.forward_range_count * sizeof(SnapshotForwardRangeRecord);
+        const uint32_t word_id = 1000000;
+        memcpy(content.data() + entry_offset + offsetof(ForwardIndex::Entry, word_id), &word_id, sizeof(word_id));
+        info.checksum = ComputeChecksum(content.data() + info.offset, info.size);
+        break;
+    }
+    memcpy(content.data(), &header, sizeof(header));
+    header.checksum = ComputeChecksum(content.data(), offsetof(SnapshotHeader, checksum));
+    memcpy(content.data(), &header, sizeof(header));
+    ofstream(path, ios::binary) << content;
+    thrown = false;
+    try {
+        SearchServer::LoadSnapshot(path);
+    } catch (const runtime_error&) {
+        thrown = true;
+    }
+    ASSERT_HINT(thrown, "Forward index entries must refer to dictionary words"s);
+    remove(path.c_str());
+}
+
+void TestDurableSearchServer() {
+    const auto directory = filesystem::temp_directory_path();
+    const string snapshot_path = (directory / "durable_test.snapshot"s).string();
+    const string log_path = (directory / "durable_test.log"s).string();
+    remove(snapshot_path.c_str());
+    remove(log_path.c_str());
+
+    {
+        DurableSearchServer server("and"s, snapshot_path, log_path);
+        vector<thread> writers;
+        for (int writer = 0; writer < 4; ++writer) {
+            writers.emplace_back([&server, writer] {
+                for (int i = 0; i < 25; ++i) {
+                    const int id = writer * 100 + i;
+                    server.AddDocument(id, "cat and dog number"s + to_string(id), DocumentStatus::ACTUAL, {id});
+                }
+            });
+        }
+        for (auto& writer : writers) {
+            writer.join();
+        }
+        server.RemoveDocument(0);
+        ASSERT_EQUAL(server.GetLastSequenceNumber(), 101u);
+    }
+    {
+        DurableSearchServer server("and"s, snapshot_path, log_path);
+        ASSERT_EQUAL(server.GetSearchServer().GetDocumentCount(), 99);
+        ASSERT(server.GetSearchServer().FindTopDocuments("number0"s).empty());
+        ASSERT_EQUAL(server.GetSearchServer().FindTopDocuments("number324"s).size(), 1u);
+
+        server.Checkpoint();
+        server.AddDocument(1000, "parrot"s, DocumentStatus::BANNED, {5});
+
+        // a rejected update is logged and rejected again on replay
+        bool thrown = false;
+        try {
+            server.AddDocument(1000, "crow"s, DocumentStatus::ACTUAL, {1});
+        } catch (const invalid_argument&) {
+            thrown = true;
+        }
+        ASSERT(thrown);
+        ASSERT_EQUAL(server.GetLastSequenceNumber(), 103u);
+        server.RemoveDocument(1000);
+        server.AddDocument(1000, "parrot"s, DocumentStatus::BANNED, {5});
+        ASSERT_EQUAL(server.GetLastSequenceNumber(), 105u);
+    }
+
+    // a record torn by a crash must be skipped
+    {
+        ofstream log(log_path, ios::binary | ios::app);
+        log << "torn record"s;
+    }
+    {
+        DurableSearchServer server("and"s, snapshot_path, log_path);
+        ASSERT_EQUAL(server.GetSearchServer().GetDocumentCount(), 100);
+        ASSERT_EQUAL(server.GetSearchServer().FindTopDocuments("parrot"s, DocumentStatus::BANNED).size(), 1u);
+        ASSERT(server.GetSearchServer().FindTopDocuments("crow"s).empty());
+        ASSERT_EQUAL(server.GetLastSequenceNumber(), 105u);
+        server.RemoveDocument(1000);
+    }
+    {
+        DurableSearchServer server("and"s, snapshot_path, log_path);
+        ASSERT_EQUAL(server.GetSearchServer().GetDocumentCount(), 99);
+        ASSERT_EQUAL(server.GetLastSequenceNumber(), 106u);
+    }
+    remove(snapshot_path.c_str());
+    remove(log_path.c_str());
+
+    // a failed log write is final: later updates and checkpoints fail instead of hanging,
+    // and recovery keeps exactly the acknowledged updates. The child gets a temporary file size limit
+    const pid_t child = fork();
+    ASSERT(child >= 0);
+    if (child == 0) {
+        alarm(10);
+        signal(SIGXFSZ, SIG_IGN);
+        rlimit limit = {4096, RLIM_INFINITY};
+        setrlimit(RLIMIT_FSIZE, &limit);
+        int acknowledged = 0;
+        try {
+            DurableSearchServer server("and"s, snapshot_path, log_path);
+            try {
+                for (int id = 0; id < 100; ++id) {
+                    server.AddDocument(id, "cat number"s + to_string(id) + string(200, 'x'), DocumentStatus::ACTUAL, {id});
+                    ++acknowledged;
+                }
+                _exit(255);
+            } catch (const runtime_error&) {
+            }
+            // the disk has room again, the log stays failed anyway
+            limit.rlim_cur = RLIM_INFINITY;
+            setrlimit(RLIMIT_FSIZE, &limit);
+            for (int id = 100; id < 103; ++id) {
+                try {
+                    server.AddDocument(id, "dog"s, DocumentStatus::ACTUAL, {1});
+                    _exit(255);
+                } catch (const runtime_error&) {
+                }
+            }
+            try {
+                server.Checkpoint();
+                _exit(255);
+            } catch (const runtime_error&) {
+            }
+            if (server.GetSearchServer().GetDocumentCount() != acknowledged) {
+                _exit(255);
+            }
+        } catch (...) {
+            _exit(255);
+        }
+        _exit(acknowledged);
+    }
+    int child_status = 0;
+    waitpid(child, &child_status, 0);
+    ASSERT_HINT(WIFEXITED(child_status) && WEXITSTATUS(child_status) != 255, "Updates after a failed write must fail, not hang"s);
+    {
+        DurableSearchServer server("and"s, snapshot_path, log_path);
+        ASSERT_EQUAL(server.GetSearchServer().GetDocumentCount(), WEXITSTATUS(child_status));
+    }
+    remove(snapshot_path.c_str());
+    remove(log_path.c_str());
+}
+
 // TestSearchServer - entry point for running module tests
 void TestSearchServer() {
     RUN_TEST(TestExcludeStopWordsFromAddedDocumentContent);
@@ -225,6 +1658,30 @@ void TestSearchServer() {
     RUN_TEST(TestFilterPredicate);
     RUN_TEST(TestDocumentsByStatus);
     RUN_TEST(TestRelevanceDocument);
+    RUN_TEST(TestRemoveDocuments);
+    RUN_TEST(TestReclaimDeadWords);
+    RUN_TEST(TestWordFrequencies);
+    RUN_TEST(TestDisabledForwardIndex);
+    RUN_TEST(TestRemoveDuplicates);
+    RUN_TEST(TestNearDuplicates);
+    RUN_TEST(TestDuplicatePolicy);
+    RUN_TEST(TestSnapshot);
+    RUN_TEST(TestDurableSearchServer);
+    RUN_TEST(TestWriteBlocks);
+    RUN_TEST(TestStableText);
+    RUN_TEST(TestCorpusLoader);
+    RUN_TEST(TestIngestionPipeline);
+    RUN_TEST(TestConcurrentAddDocument);
+    RUN_TEST(TestShardedSearchServer);
+    RUN_TEST(TestNumaPlacement);
+    RUN_TEST(TestSearchCoordinator);
+    RUN_TEST(TestNetworkServer);
+    RUN_TEST(TestReadReplica);
+    RUN_TEST(TestProcessQueriesBatch);
+    RUN_TEST(TestProcessQueriesJoinedStream);
+    RUN_TEST(TestAsyncSearchServer);
+    RUN_TEST(TestQueryLimits);
+    RUN_TEST(TestQueryScheduler);
 }
 // end of module tests
 
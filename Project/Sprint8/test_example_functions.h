@@ -10,7 +10,7 @@
 template<typename T, typename U>
 std::ostream& operator<<(std::ostream& out, const std::map<T, U> container) {
     out << "{";
-    int i = 0;
+    size_t i = 0;
     for (const auto& [key, value] : container) {
         out << key << ": " << value;
         if (i + 1 != container.size())
@@ -24,7 +24,7 @@ std::ostream& operator<<(std::ostream& out, const std::map<T, U> container) {
 template<typename T>
 std::ostream& operator<<(std::ostream& out, const std::set<T> container) {
     out << "{";
-    int i = 0;
+    size_t i = 0;
     for (const auto& elem : container) {
         out << elem;
         if (i + 1 != container.size())
@@ -38,7 +38,7 @@ std::ostream& operator<<(std::ostream& out, const std::set<T> container) {
 template<typename T>
 std::ostream& operator<<(std::ostream& out, const std::vector<T> container) {
     out << "[";
-    int i = 0;
+    size_t i = 0;
     for (const auto& elem : container) {
         out << elem;
         if (i + 1 != container.size())
@@ -100,6 +100,54 @@ void TestFilterPredicate();
 void TestDocumentsByStatus();
 
 void TestRelevanceDocument();
+
+void TestRemoveDocuments();
+
+void TestReclaimDeadWords();
+
+void TestWordFrequencies();
+
+void TestDisabledForwardIndex();
+
+void TestRemoveDuplicates();
+
+void TestNearDuplicates();
+
+void TestDuplicatePolicy();
+
+void TestStableText();
+
+void TestCorpusLoader();
+
+void TestIngestionPipeline();
+
+void TestConcurrentAddDocument();
+
+void TestShardedSearchServer();
+
+void TestNumaPlacement();
+
+void TestSearchCoordinator();
+
+void TestNetworkServer();
+
+void TestReadReplica();
+
+void TestProcessQueriesBatch();
+
+void TestProcessQueriesJoinedStream();
+
+void TestAsyncSearchServer();
+
+void TestQueryLimits();
+
+void TestQueryScheduler();
+
+void TestWriteBlocks();
+
+void TestSnapshot();
+
+void TestDurableSearchServer();
 // TestSearchServer - entry point for running module tests
 void TestSearchServer();
 // end of module tests
@@ -0,0 +1,291 @@
+#include "checksum.h"
+#include "mapped_file.h"
+#include "write_ahead_log.h"
+
+#include <cerrno>
+#include <cstring>
+#include <filesystem>
+#include <limits>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+using namespace std;
+
+namespace {
+
+// Record frame: payload size, reserved word, payload checksum, payload
+struct FrameHeader {
+    uint32_t payload_size = 0;
+    uint32_t reserved = 0;
+    uint64_t checksum = 0;
+};
+
+template <typename T>
+void AppendValue(string& out, T value) {
+    out.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+template <typename T>
+bool ReadValue(string_view& in, T& value) {
+    if (in.size() < sizeof(value)) {
+        return false;
+    }
+    memcpy(&value, in.data(), sizeof(value));
+    in.remove_prefix(sizeof(value));
+    return true;
+}
+
+void EncodeRecord(const LogRecord& record, string& out) {
+    string payload;
+    AppendValue(payload, record.sequence_number);
+    AppendValue(payload, static_cast<uint8_t>(record.operation));
+    AppendValue(payload, static_cast<uint8_t>(record.status));
+    AppendValue(payload, static_cast<int32_t>(record.document_id));
+    AppendValue(payload, static_cast<uint32_t>(record.ratings.size()));
+    for (const int rating : record.ratings) {
+        AppendValue(payload, static_cast<int32_t>(rating));
+    }
+    AppendValue(payload, static_cast<uint32_t>(record.text.size()));
+    payload += record.text;
+
+    AppendValue(out, FrameHeader{static_cast<uint32_t>(payload.size()), 0, ComputeChecksum(payload.data(), payload.size())});
+    out += payload;
+}
+
+bool DecodeRecord(string_view payload, LogRecord& record) {
+    uint8_t operation = 0;
+    uint8_t status = 0;
+    int32_t document_id = 0;
+    uint32_t rating_count = 0;
+    if (!ReadValue(payload, record.sequence_number) || !ReadValue(payload, operation) || !ReadValue(payload, status)
+        || !ReadValue(payload, document_id) || !ReadValue(payload, rating_count)
+        || payload.size() < static_cast<size_t>(rating_count) * sizeof(int32_t)) {
+        return false;
+    }
+    if (operation < static_cast<uint8_t>(LogOperation::ADD_DOCUMENT) || operation > static_cast<uint8_t>(LogOperation::REMOVE_DOCUMENT)
+        || status > static_cast<uint8_t>(DocumentStatus::REMOVED)) {
+        return false;
+    }
+    record.operation = static_cast<LogOperation>(operation);
+    record.status = static_cast<DocumentStatus>(status);
+    record.document_id = document_id;
+
+    record.ratings.resize(rating_count);
+    for (int& rating : record.ratings) {
+        int32_t value = 0;
+        ReadValue(payload, value);
+        rating = value;
+    }
+
+    uint32_t text_size = 0;
+    if (!ReadValue(payload, text_size) || payload.size() != text_size) {
+        return false;
+    }
+    record.text = payload;
+    return true;
+}
+
+// Calls callback for at most max_records intact records at the start of data.
+// Returns their total size, damaged tells whether reading stopped at a record that is complete but broken
+size_t ParseRecords(string_view data, size_t max_records, const function<void(const LogRecord&)>& callback,
+    size_t& record_count, bool& damaged) {
+    size_t intact_size = 0;
+    record_count = 0;
+    damaged = false;
+
+    // reading stops at the first incomplete or damaged record
+    while (record_count < max_records) {
+        FrameHeader frame;
+        if (!ReadValue(data, frame) || data.size() < frame.payload_size) {
+            break;
+        }
+        const string_view payload = data.substr(0, frame.payload_size);
+        LogRecord record;
+        if (frame.checksum != ComputeChecksum(payload.data(), payload.size()) || !DecodeRecord(payload, record)) {
+            damaged = true;
+            break;
+        }
+
+        data.remove_prefix(frame.payload_size);
+        intact_size += sizeof(FrameHeader) + frame.payload_size;
+        ++record_count;
+        callback(record);
+    }
+    return intact_size;
+}
+
+bool WriteAll(int fd, const string& data) {
+    size_t written = 0;
+    while (written < data.size()) {
+        const ssize_t result = write(fd, data.data() + written, data.size() - written);
+        if (result < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        written += static_cast<size_t>(result);
+    }
+    return true;
+}
+
+}  // namespace
+
+WriteAheadLog::WriteAheadLog(const string& path, uint64_t last_sequence_number, WriteAheadLogOptions options)
+    : options_(options) {
+    const size_t intact_size = Read(path, [&last_sequence_number](const LogRecord& record) {
+        last_sequence_number = max(last_sequence_number, record.sequence_number);
+    });
+    next_sequence_number_ = last_sequence_number + 1;
+    durable_sequence_number_ = last_sequence_number;
+
+    fd_ = open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+    if (fd_ < 0) {
+        throw runtime_error("Can't open log "s + path + ": "s + strerror(errno));
+    }
+    if (ftruncate(fd_, static_cast<off_t>(intact_size)) != 0) {
+        const int error = errno;
+        close(fd_);
+        throw runtime_error("Can't cut damaged tail of log "s + path + ": "s + strerror(error));
+    }
+
+    flusher_ = thread([this] { FlushLoop(); });
+}
+
+WriteAheadLog::~WriteAheadLog() {
+    {
+        lock_guard guard(mutex_);
+        stop_ = true;
+    }
+    has_pending_.notify_one();
+    flusher_.join();
+    close(fd_);
+}
+
+uint64_t WriteAheadLog::Enqueue(const LogRecord& record) {
+    lock_guard guard(mutex_);
+    if (failed_) {
+        throw runtime_error("Write-ahead log is not writable"s);
+    }
+    LogRecord numbered = record;
+    numbered.sequence_number = next_sequence_number_++;
+    EncodeRecord(numbered, pending_);
+    has_pending_.notify_one();
+    return numbered.sequence_number;
+}
+
+void WriteAheadLog::WaitDurable(uint64_t sequence_number) {
+    unique_lock lock(mutex_);
+    durable_changed_.wait(lock, [this, sequence_number] {
+        return failed_ || durable_sequence_number_ >= sequence_number;
+    });
+    // records written before the failure stay durable
+    if (durable_sequence_number_ < sequence_number) {
+        throw runtime_error("Write-ahead log is not writable"s);
+    }
+}
+
+uint64_t WriteAheadLog::Append(const LogRecord& record) {
+    const uint64_t sequence_number = Enqueue(record);
+    WaitDurable(sequence_number);
+    return sequence_number;
+}
+
+void WriteAheadLog::Truncate() {
+    unique_lock lock(mutex_);
+    durable_changed_.wait(lock, [this] {
+        return failed_ || durable_sequence_number_ + 1 == next_sequence_number_;
+    });
+    if (failed_ || ftruncate(fd_, 0) != 0) {
+        throw runtime_error("Can't truncate write-ahead log"s);
+    }
+}
+
+void WriteAheadLog::FlushLoop() {
+    unique_lock lock(mutex_);
+    while (true) {
+        has_pending_.wait(lock, [this] { return stop_ || !pending_.empty(); });
+        if (pending_.empty()) {
+            return;
+        }
+
+        // give concurrent writers a chance to join the group
+        if (options_.group_commit_window.count() > 0 && !stop_) {
+            lock.unlock();
+            this_thread::sleep_for(options_.group_commit_window);
+            lock.lock();
+        }
+
+        string batch;
+        batch.swap(pending_);
+        const uint64_t last_in_batch = next_sequence_number_ - 1;
+
+        lock.unlock();
+        const bool written = WriteAll(fd_, batch) && fdatasync(fd_) == 0;
+        lock.lock();
+
+        if (written) {
+            durable_sequence_number_ = last_in_batch;
+        }
+        else {
+            // the file may end in a torn frame now, nothing is written after it, so
+            // durable_sequence_number_ never passes the failed batch
+            failed_ = true;
+            pending_.clear();
+        }
+        durable_changed_.notify_all();
+    }
+}
+
+size_t WriteAheadLog::Read(const string& path, const function<void(const LogRecord&)>& callback) {
+    if (!filesystem::exists(path)) {
+        return 0;
+    }
+
+    const MappedFile file(path);
+    size_t record_count = 0;
+    bool damaged = false;
+    return ParseRecords(file.View(), numeric_limits<size_t>::max(), callback, record_count, damaged);
+}
+
+size_t WriteAheadLog::ReadFrom(const string& path, size_t offset, size_t max_records,
+    const function<void(const LogRecord&)>& callback) {
+    const int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        if (errno == ENOENT) {
+            return 0;
+        }
+        throw runtime_error("Can't open log "s + path + ": "s + strerror(errno));
+    }
+
+    // buffer holds the file bytes starting at offset
+    string buffer;
+    size_t record_count = 0;
+    bool damaged = false;
+    try {
+        while (record_count < max_records && !damaged) {
+            char chunk[1 << 16];
+            const ssize_t result = pread(fd, chunk, sizeof(chunk), static_cast<off_t>(offset + buffer.size()));
+            if (result < 0 && errno == EINTR) {
+                continue;
+            }
+            if (result <= 0) {
+                break;
+            }
+            buffer.append(chunk, static_cast<size_t>(result));
+
+            size_t parsed_count = 0;
+            const size_t intact_size = ParseRecords(buffer, max_records - record_count, callback, parsed_count, damaged);
+            record_count += parsed_count;
+            offset += intact_size;
+            buffer.erase(0, intact_size);
+        }
+    } catch (...) {
+        close(fd);
+        throw;
+    }
+    close(fd);
+    return offset;
+}
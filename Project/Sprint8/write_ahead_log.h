@@ -0,0 +1,86 @@
+#pragma once
+
+#include "document.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct WriteAheadLogOptions {
+    // Records queued within this window after the first pending one share one fsync
+    std::chrono::microseconds group_commit_window{200};
+};
+
+enum class LogOperation : uint8_t {
+    ADD_DOCUMENT = 1,
+    REMOVE_DOCUMENT = 2,
+};
+
+struct LogRecord {
+    uint64_t sequence_number = 0;
+    LogOperation operation = LogOperation::ADD_DOCUMENT;
+    int document_id = 0;
+    DocumentStatus status = DocumentStatus::ACTUAL;
+    std::vector<int> ratings;
+    std::string text;
+};
+
+// Append-only log of index updates with checksummed records and group commit:
+// one background thread writes and fsyncs everything queued by concurrent writers at once
+class WriteAheadLog {
+public:
+    // Opens the log for appending. A damaged tail left by a crash is cut off.
+    // Sequence numbers continue after last_sequence_number or after the last record in the file
+    WriteAheadLog(const std::string& path, uint64_t last_sequence_number, WriteAheadLogOptions options = {});
+
+    WriteAheadLog(const WriteAheadLog&) = delete;
+    WriteAheadLog& operator=(const WriteAheadLog&) = delete;
+
+    // Flushes the queued records
+    ~WriteAheadLog();
+
+    // Queues the record and returns its sequence number without waiting for the disk.
+    // A failed write is final: the log takes no more records and throws std::runtime_error
+    uint64_t Enqueue(const LogRecord& record);
+
+    // Blocks until the record is on disk. Throws std::runtime_error if it never gets there
+    // because writing failed
+    void WaitDurable(uint64_t sequence_number);
+
+    uint64_t Append(const LogRecord& record);
+
+    // Drops all records once they are on disk, used after a checkpoint
+    void Truncate();
+
+    // Calls callback for every intact record in order.
+    // Returns the size of the intact part of the file, a missing file is empty
+    static size_t Read(const std::string& path, const std::function<void(const LogRecord&)>& callback);
+
+    // Incremental reading for a follower of the log: calls callback for at most max_records intact records
+    // starting at offset, which must be a record boundary. Uses plain reads, so the file may be appended to
+    // or truncated meanwhile. Returns the offset after the last record read, a missing file is empty
+    static size_t ReadFrom(const std::string& path, size_t offset, size_t max_records,
+        const std::function<void(const LogRecord&)>& callback);
+
+private:
+    void FlushLoop();
+
+    WriteAheadLogOptions options_;
+    int fd_ = -1;
+
+    std::mutex mutex_;
+    std::condition_variable has_pending_;
+    std::condition_variable durable_changed_;
+    std::string pending_;
+    uint64_t next_sequence_number_ = 1;
+    uint64_t durable_sequence_number_ = 0;
+    bool failed_ = false;
+    bool stop_ = false;
+
+    std::thread flusher_;
+};